@@ -0,0 +1,278 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <getopt.h>
+#include <sys/resource.h>
+
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "cancel_token.h"
+#include "config.h"
+#include "scripted_tuner.h"
+#include "sweep.h"
+#include "tsid_scan.h"
+
+namespace
+{
+
+int64_t percentile(std::vector<int64_t> values, double p)
+{
+	if (values.empty()) { return 0; }
+	std::sort(values.begin(), values.end());
+	auto rank = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+	return values.at(rank);
+}
+
+nlohmann::json summary(const std::vector<int64_t>& values)
+{
+	return nlohmann::json{
+		{"count", values.size()},
+		{"p50", percentile(values, 0.50)},
+		{"p99", percentile(values, 0.99)},
+		{"max", values.empty() ? 0 : *std::max_element(values.begin(), values.end())},
+	};
+}
+
+int64_t peak_rss_kb()
+{
+	struct ::rusage usage;
+	return ::getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+std::string usage(const std::string& argv0)
+{
+	return "\n"
+		"usage: " + argv0 + " [options] [-- px4tsid options without DEVICE]\n"
+		"\n"
+		"options:\n"
+		"  --help                     show this help message\n"
+		"  --script=file              tuner timing script (json)\n"
+		"  --table=file               TSID table served by the scripted tuner (" PX4TSID_BENCH_TABLE ")\n"
+		"  --time-scale=x             multiply every scripted delay and px4tsid timeout by x\n"
+		"  --repeat=n                 number of full scans (1)\n"
+		"  --tuners=n                 number of scripted tuners scanning at once (1)\n"
+		"  --history=file             table of the last scan for --time-budget (none)\n";
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		const option long_options[] = {
+			{"help", no_argument, 0, 'h'},
+			{"script", required_argument, 0, 's'},
+			{"table", required_argument, 0, 't'},
+			{"time-scale", required_argument, 0, 'x'},
+			{"repeat", required_argument, 0, 'n'},
+			{"tuners", required_argument, 0, 'u'},
+			{"history", required_argument, 0, 'y'},
+			{0,0,0,0},
+		};
+
+		auto sep = std::find_if(argv, argv + argc, [](const char* a) { return std::string(a) == "--"; });
+		auto bench_argc = static_cast<int>(sep - argv);
+
+		px4tsid::Script script;
+		std::string table_path = PX4TSID_BENCH_TABLE;
+		double time_scale = 0;
+		auto repeat = 1;
+		auto tuners = 1;
+		std::string history_path;
+		while (true)
+		{
+			auto option_index = 0;
+			auto c = getopt_long(bench_argc, argv, "hs:t:x:n:u:y:", long_options, &option_index);
+			if (c == -1) { break; }
+			switch (c)
+			{
+			case 's':
+				script.load(optarg);
+				break;
+			case 't':
+				table_path = optarg;
+				break;
+			case 'x':
+				time_scale = std::atof(optarg);
+				break;
+			case 'n':
+				repeat = std::max(1, std::atoi(optarg));
+				break;
+			case 'u':
+				tuners = std::max(1, std::atoi(optarg));
+				break;
+			case 'y':
+				history_path = optarg;
+				break;
+			case 'h':
+			default:
+				throw std::runtime_error(usage(argv[0]));
+			}
+		}
+		if (time_scale > 0)
+		{
+			script.time_scale = time_scale;
+		}
+
+		std::ifstream ifs(table_path);
+		if (!ifs)
+		{
+			throw std::runtime_error("failed to open table " + table_path);
+		}
+		script.load_table(nlohmann::json::parse(ifs));
+
+		nlohmann::json history;
+		if (!history_path.empty())
+		{
+			std::ifstream hfs(history_path);
+			if (!hfs)
+			{
+				throw std::runtime_error("failed to open history " + history_path);
+			}
+			history = nlohmann::json::parse(hfs);
+		}
+
+		std::vector<char*> scan_argv = { argv[0] };
+		for (auto p = sep == argv + argc ? sep : sep + 1; p != argv + argc; p++)
+		{
+			scan_argv.push_back(*p);
+		}
+		std::vector<std::string> devices;
+		for (auto i = 0; i < tuners; i++)
+		{
+			devices.push_back(tuners == 1 ? "scripted" : "scripted" + std::to_string(i));
+		}
+		for (auto& device : devices)
+		{
+			scan_argv.push_back(device.data());
+		}
+		optind = 1;
+		px4tsid::Config config;
+		config.parse(scan_argv.size(), scan_argv.data());
+		config.set_io_timeout(std::chrono::duration_cast<std::chrono::milliseconds>(config.io_timeout() * script.time_scale));
+		config.set_slot_timeout(std::chrono::duration_cast<std::chrono::milliseconds>(config.slot_timeout() * script.time_scale));
+		config.set_tuners(tuners);
+
+		if (config.is_sweep())
+		{
+			std::vector<int64_t> total_ms;
+			uint64_t tunes = 0;
+			nlohmann::json carriers;
+			for (auto i = 0; i < repeat; i++)
+			{
+				std::vector<px4tsid::ScriptedTuner*> scripted;
+				px4tsid::Sweep sweep;
+				px4tsid::CancelToken cancel;
+				sweep.init(config);
+				sweep.set_tuner_factory([&] {
+					auto tuner = std::make_unique<px4tsid::ScriptedTuner>(script);
+					scripted.push_back(tuner.get());
+					return tuner;
+				});
+				auto start = std::chrono::steady_clock::now();
+				sweep.sweep(cancel);
+				total_ms.push_back(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+				for (auto p : scripted)
+				{
+					tunes += p->tunes();
+				}
+				carriers = sweep.json();
+			}
+			auto j = nlohmann::json{
+				{"repeat", repeat},
+				{"time_scale", script.time_scale},
+				{"total_ms", summary(total_ms)},
+				{"tunes", tunes / repeat},
+				{"carriers", carriers},
+			};
+			std::cout << j.dump(4) << '\n';
+			return 0;
+		}
+
+		std::vector<int64_t> total_ms;
+		std::vector<int64_t> tsid_ms;
+		std::vector<int64_t> slot_ms;
+		std::map<std::string, int64_t> statuses;
+		std::map<std::string, std::vector<int64_t>> transponder_slot_ms;
+		uint64_t tunes = 0;
+		uint64_t bytes_read = 0;
+
+		for (auto i = 0; i < repeat; i++)
+		{
+			std::vector<px4tsid::ScriptedTuner*> scripted;
+			px4tsid::TSIDScan scan;
+			px4tsid::CancelToken cancel;
+			scan.init(config);
+			if (!history.is_null())
+			{
+				scan.set_history(history);
+			}
+			scan.set_tuner_factory([&] {
+				auto tuner = std::make_unique<px4tsid::ScriptedTuner>(script);
+				scripted.push_back(tuner.get());
+				return tuner;
+			});
+
+			auto start = std::chrono::steady_clock::now();
+			scan.scan([&](const px4tsid::SlotResult& r) {
+				slot_ms.push_back(r.elapsed.count());
+				if (r.status == px4tsid::SlotStatus::found)
+				{
+					tsid_ms.push_back(r.elapsed.count());
+				}
+				statuses[nlohmann::json(r.status)]++;
+				transponder_slot_ms[r.transponder].push_back(r.elapsed.count());
+			}, cancel);
+			total_ms.push_back(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+			for (auto p : scripted)
+			{
+				tunes += p->tunes();
+				bytes_read += p->bytes_read();
+			}
+		}
+
+		// time spent on each transponder per scan, the sum of its slots
+		auto transponders = nlohmann::json::object();
+		for (const auto& [transponder, values] : transponder_slot_ms)
+		{
+			int64_t sum = 0;
+			for (auto v : values) { sum += v; }
+			transponders[transponder] = nlohmann::json{
+				{"total_ms", sum / repeat},
+				{"slot_ms", summary(values)},
+			};
+		}
+
+		auto j = nlohmann::json{
+			{"repeat", repeat},
+			{"time_scale", script.time_scale},
+			{"total_ms", summary(total_ms)},
+			{"time_to_tsid_ms", summary(tsid_ms)},
+			{"slot_ms", summary(slot_ms)},
+			{"tunes", tunes / repeat},
+			{"bytes_read", bytes_read / repeat},
+			{"status", statuses},
+			{"peak_rss_kb", peak_rss_kb()},
+			{"transponders", transponders},
+		};
+		std::cout << j.dump(4) << '\n';
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << ex.what() << '\n';
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,332 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.hpp"
+
+#include "chset.h"
+#include "scan_plan.h"
+#include "scripted_tuner.h"
+
+namespace px4tsid
+{
+
+void Script::load(const std::string& path)
+{
+	std::ifstream ifs(path);
+	if (!ifs)
+	{
+		throw std::runtime_error("failed to open script " + path);
+	}
+
+	auto j = nlohmann::json::parse(ifs);
+	time_scale = j.value("time_scale", time_scale);
+	system_mode_delay = std::chrono::milliseconds(j.value("system_mode_delay_ms", system_mode_delay.count()));
+	lock_delay = std::chrono::milliseconds(j.value("lock_delay_ms", lock_delay.count()));
+	start_delay = std::chrono::milliseconds(j.value("start_delay_ms", start_delay.count()));
+	stop_delay = std::chrono::milliseconds(j.value("stop_delay_ms", stop_delay.count()));
+	stale_delay = std::chrono::milliseconds(j.value("stale_delay_ms", stale_delay.count()));
+	retune_while_streaming = j.value("retune_while_streaming", retune_while_streaming);
+	pat_interval = std::chrono::milliseconds(j.value("pat_interval_ms", pat_interval.count()));
+	error_burst_every = std::chrono::milliseconds(j.value("error_burst_every_ms", error_burst_every.count()));
+	error_burst_length = std::chrono::milliseconds(j.value("error_burst_length_ms", error_burst_length.count()));
+	slow_lock_rate = j.value("slow_lock_rate", slow_lock_rate);
+	slow_lock_delay = std::chrono::milliseconds(j.value("slow_lock_delay_ms", slow_lock_delay.count()));
+	bitrate_kbps = j.value("bitrate_kbps", bitrate_kbps);
+	capture_khz = j.value("capture_khz", capture_khz);
+	no_lock_delay = std::chrono::milliseconds(j.value("no_lock_delay_ms", no_lock_delay.count()));
+	for (const auto& [idx, delay] : j.value("lock_delays_ms", std::unordered_map<std::string, int32_t>{}))
+	{
+		lock_delays[std::stoi(idx)] = std::chrono::milliseconds(delay);
+	}
+	for (auto idx : j.value("dead_transponders", std::vector<int32_t>{}))
+	{
+		dead_transponders.emplace(idx);
+	}
+}
+
+void Script::load_table(const nlohmann::json& table)
+{
+	transport_stream_ids.clear();
+	for (const auto& band : {"BS", "CS"})
+	{
+		for (const auto& c : table.at(band).get<std::vector<ChSet>>())
+		{
+			// an unused slot delivers the first TS of the transponder
+			auto first = std::find_if(c.transport_stream_id().begin(), c.transport_stream_id().end(), [](uint16_t tsid) { return tsid != 0xffff; });
+			if (first == c.transport_stream_id().end()) continue;
+			for (size_t slot = 0; slot < c.transport_stream_id().size(); slot++)
+			{
+				auto tsid = c.transport_stream_id(slot);
+				transport_stream_ids[slot_key(c.frequency_idx(), slot)] = tsid == 0xffff ? *first : tsid;
+			}
+		}
+	}
+}
+
+ScriptedTuner::ScriptedTuner(const Script& script) : script_(script)
+{
+	timer_fd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer_fd_ == -1)
+	{
+		throw std::runtime_error("failed to timerfd_create");
+	}
+}
+
+ScriptedTuner::~ScriptedTuner()
+{
+	::close(timer_fd_);
+}
+
+void ScriptedTuner::open_tuner(const std::string& device)
+{
+	device_ = device;
+	is_open_ = true;
+	// every tuner draws its own slow locks, the same ones on every run
+	random_state_ = std::hash<std::string>()(device) | 1;
+}
+
+void ScriptedTuner::close_tuner()
+{
+	stop_streaming();
+	is_open_ = false;
+	has_system_mode_ = false;
+}
+
+void ScriptedTuner::set_channel_s(int32_t freq_num, int32_t slot_num)
+{
+	tune(freq_num, slot_num, "ioctl(PTX_SET_CHANNEL)");
+}
+
+void ScriptedTuner::set_frequency_s(uint32_t frequency_khz, int32_t slot_num)
+{
+	for (auto idx = 0; idx < ScanPlan::TRANSPONDER_SIZE_BS + ScanPlan::TRANSPONDER_SIZE_CS; idx++)
+	{
+		auto khz = ScanPlan::frequency_khz(idx);
+		if ((khz > frequency_khz ? khz - frequency_khz : frequency_khz - khz) <= script_.capture_khz)
+		{
+			tune(idx, slot_num, "ioctl(PTXT_TUNE)");
+			return;
+		}
+	}
+
+	tunes_++;
+	sleep(script_.no_lock_delay, "ioctl(PTXT_TUNE)");
+	std::ostringstream os;
+	os << "failed to ioctl(PTXT_TUNE) freq: " << frequency_khz << "kHz slot: " << slot_num;
+	throw std::runtime_error(os.str());
+}
+
+void ScriptedTuner::tune(int32_t freq_num, int32_t slot_num, const std::string& op)
+{
+	tunes_++;
+	if (!has_system_mode_)
+	{
+		sleep(script_.system_mode_delay, "ioctl(PTX_SET_SYSTEM_MODE)");
+		has_system_mode_ = true;
+	}
+
+	if (has_streaming_ && !script_.retune_while_streaming)
+	{
+		stop_streaming();
+	}
+
+	auto previous_tsid = transport_stream_id();
+
+	auto it = script_.lock_delays.find(freq_num);
+	auto lock_delay = it == script_.lock_delays.end() ? script_.lock_delay : it->second;
+	if (script_.slow_lock_rate > 0 && random() < script_.slow_lock_rate)
+	{
+		lock_delay = script_.slow_lock_delay;
+	}
+	sleep(lock_delay, op);
+	if (script_.dead_transponders.count(freq_num))
+	{
+		std::ostringstream os;
+		os << "failed to " << op << " freq: " << freq_num << " slot: " << slot_num;
+		throw std::runtime_error(os.str());
+	}
+
+	frequency_idx_ = freq_num;
+	slot_ = slot_num;
+	if (has_streaming_)
+	{
+		// the queue is drained, but packets in flight still belong to the previous slot
+		packets_ = available_packets();
+		stale_packets_end_ = packets_ + static_cast<uint64_t>(script_.stale_delay.count() * script_.bitrate_kbps / 8.0 / 188);
+		stale_tsid_ = previous_tsid;
+	}
+}
+
+void ScriptedTuner::start_streaming()
+{
+	if (has_streaming_) { return; }
+	sleep(script_.start_delay, "ioctl(PTX_START_STREAMING)");
+	stream_start_ = clock::now();
+	packets_ = 0;
+	stale_packets_end_ = 0;
+	has_streaming_ = true;
+}
+
+void ScriptedTuner::stop_streaming()
+{
+	if (!has_streaming_) { return; }
+	std::this_thread::sleep_for(script_.stop_delay * script_.time_scale);
+	has_streaming_ = false;
+}
+
+ssize_t ScriptedTuner::read_stream(uint8_t* buf, size_t size)
+{
+	using namespace std::chrono_literals;
+
+	if (!has_streaming_)
+	{
+		return -ENODATA;
+	}
+
+	auto tsid = transport_stream_id();
+	if (tsid == 0xffff && packets_ >= stale_packets_end_)
+	{
+		// unused transponder, the tuner never delivers a packet
+		sleep(std::chrono::hours(1), "read");
+	}
+
+	auto bytes_per_ms = script_.bitrate_kbps / 8.0;
+	uint64_t expirations;
+	while (::read(timer_fd_, &expirations, sizeof(expirations)) > 0) {}
+	read_size_ = size;
+	auto max_packets = static_cast<uint64_t>(size / 188);
+	auto chunk_packets = max_packets;
+	auto available = available_packets();
+	if (available < packets_ + chunk_packets)
+	{
+		auto wait_ms = (packets_ + chunk_packets - available) * 188 / bytes_per_ms;
+		sleep(std::chrono::milliseconds(static_cast<int64_t>(wait_ms) + 1), "read");
+		available = packets_ + chunk_packets;
+	}
+
+	auto n = std::min(available - packets_, max_packets);
+	if (tsid == 0xffff)
+	{
+		n = std::min(n, stale_packets_end_ - packets_);
+	}
+	for (uint64_t i = 0; i < n; i++)
+	{
+		write_packet(buf + i * 188, packets_ + i, packets_ + i < stale_packets_end_ ? stale_tsid_ : tsid);
+	}
+	packets_ += n;
+	bytes_read_ += n * 188;
+
+	return n * 188;
+}
+
+int32_t ScriptedTuner::poll_fd()
+{
+	if (!has_streaming_)
+	{
+		return -1;
+	}
+
+	// readable once the next full read is available, never on an unused transponder
+	::itimerspec its = {};
+	if (transport_stream_id() != 0xffff || packets_ < stale_packets_end_)
+	{
+		auto packets = packets_ + read_size_ / 188;
+		auto ms = packets * 188 / (script_.bitrate_kbps / 8.0) * script_.time_scale;
+		auto at = stream_start_ + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(ms));
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(at.time_since_epoch()).count();
+		its.it_value.tv_sec = ns / 1000000000;
+		its.it_value.tv_nsec = std::max<int64_t>(ns % 1000000000, 1);
+	}
+	::timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &its, nullptr);
+	return timer_fd_;
+}
+
+uint64_t ScriptedTuner::available_packets() const
+{
+	auto elapsed_ms = std::chrono::duration<double, std::milli>(clock::now() - stream_start_).count() / script_.time_scale;
+	return static_cast<uint64_t>(elapsed_ms * script_.bitrate_kbps / 8.0 / 188);
+}
+
+uint16_t ScriptedTuner::transport_stream_id() const
+{
+	auto it = script_.transport_stream_ids.find(Script::slot_key(frequency_idx_, slot_));
+	return it == script_.transport_stream_ids.end() ? 0xffff : it->second;
+}
+
+void ScriptedTuner::sleep(std::chrono::milliseconds duration, const std::string& op) const
+{
+	using namespace std::chrono_literals;
+	auto scaled = std::chrono::duration_cast<std::chrono::milliseconds>(duration * script_.time_scale);
+	auto left = time_left(op);
+	// in steps like a driver polling the lock status, so that a cancel ends the wait
+	for (auto end = clock::now() + std::min(scaled, left); clock::now() < end; )
+	{
+		std::this_thread::sleep_for(std::min<clock::duration>(end - clock::now(), 20ms));
+		time_left(op);
+	}
+	if (scaled > left)
+	{
+		throw TimeoutError(op + " timed out");
+	}
+}
+
+double ScriptedTuner::random()
+{
+	// xorshift64*
+	random_state_ ^= random_state_ >> 12;
+	random_state_ ^= random_state_ << 25;
+	random_state_ ^= random_state_ >> 27;
+	return (random_state_ * 0x2545f4914f6cdd1dull >> 11) * 0x1.0p-53;
+}
+
+void ScriptedTuner::write_packet(uint8_t* p, uint64_t n, uint16_t tsid)
+{
+	auto bytes_per_ms = script_.bitrate_kbps / 8.0;
+	auto pat_packets = std::max<uint64_t>(1, script_.pat_interval.count() * bytes_per_ms / 188);
+	auto phase = (Script::slot_key(frequency_idx_, slot_) * 7919) % pat_packets;
+
+	std::memset(p, 0xff, 188);
+	p[0] = 0x47;
+	if (n % pat_packets == phase)
+	{
+		const uint8_t pat[] = {
+			0x40, 0x00, static_cast<uint8_t>(0x10 | (continuity_counter_++ & 0x0f)),
+			0x00, 0x00, 0xb0, 0x0d,
+			static_cast<uint8_t>(tsid >> 8), static_cast<uint8_t>(tsid & 0xff),
+			0xc1, 0x00, 0x00, 0x00, 0x01, 0xe1, 0x00,
+		};
+		std::memcpy(p + 1, pat, sizeof(pat));
+	}
+	else
+	{
+		p[1] = 0x1f;
+		p[2] = 0xff;
+		p[3] = 0x10;
+	}
+
+	if (script_.error_burst_every.count() > 0)
+	{
+		auto t = static_cast<int64_t>(n * 188 / bytes_per_ms);
+		if (t % script_.error_burst_every.count() < script_.error_burst_length.count())
+		{
+			p[1] |= 0x80;
+		}
+	}
+}
+
+}
@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "json.hpp"
+
+#include "tuner.h"
+
+namespace px4tsid
+{
+
+// Timing model of a tuner. All delays are multiplied by time_scale.
+struct Script
+{
+	void load(const std::string& path);
+	void load_table(const nlohmann::json& table);
+
+	double time_scale = 1.0;
+	std::chrono::milliseconds system_mode_delay{5};
+	std::chrono::milliseconds lock_delay{400};
+	std::chrono::milliseconds start_delay{30};
+	std::chrono::milliseconds stop_delay{30};
+	std::chrono::milliseconds stale_delay{20};
+	// false models a driver that refuses PTX_SET_CHANNEL on a running stream, PX4Device then restarts it
+	bool retune_while_streaming = true;
+	std::chrono::milliseconds pat_interval{100};
+	std::chrono::milliseconds error_burst_every{0};
+	std::chrono::milliseconds error_burst_length{0};
+	// fraction of tunes that take slow_lock_delay instead, like a marginal signal
+	double slow_lock_rate = 0;
+	std::chrono::milliseconds slow_lock_delay{3000};
+	uint32_t bitrate_kbps = 30000;
+	// frequency tuning locks this close to a transponder, elsewhere it gives up after no_lock_delay
+	uint32_t capture_khz = 1500;
+	std::chrono::milliseconds no_lock_delay{1000};
+	std::unordered_map<int32_t, std::chrono::milliseconds> lock_delays;
+	std::unordered_set<int32_t> dead_transponders;
+	std::unordered_map<uint32_t, uint16_t> transport_stream_ids;
+
+	static uint32_t slot_key(int32_t frequency_idx, int32_t slot) { return (frequency_idx << 3) | (slot & 0x07); }
+};
+
+// Stand-in for PX4Device that serves a synthetic stream according to a Script.
+class ScriptedTuner : public Tuner
+{
+public:
+	explicit ScriptedTuner(const Script& script);
+	~ScriptedTuner() override;
+
+	void set_lnb_power(bool is_enable) override {}
+	bool has_straming() const override { return has_streaming_; }
+	const std::string& device() const override { return device_; }
+	bool is_open() const override { return is_open_; }
+	void open_tuner(const std::string& device) override;
+	bool lock_tuner() override { return true; }
+	void close_tuner() override;
+	void set_channel_s(int32_t freq_num, int32_t slot_num) override;
+	void set_frequency_s(uint32_t frequency_khz, int32_t slot_num) override;
+	void start_streaming() override;
+	void stop_streaming() override;
+	ssize_t read_stream(uint8_t* buf, size_t size) override;
+	int32_t poll_fd() override;
+
+	uint64_t tunes() const { return tunes_; }
+	uint64_t bytes_read() const { return bytes_read_; }
+
+private:
+	const Script& script_;
+	std::string device_;
+	bool is_open_ = false;
+	bool has_streaming_ = false;
+	bool has_system_mode_ = false;
+	int32_t frequency_idx_ = -1;
+	int32_t slot_ = -1;
+	clock::time_point stream_start_;
+	uint64_t packets_ = 0;
+	uint64_t stale_packets_end_ = 0;
+	uint16_t stale_tsid_ = 0xffff;
+	uint8_t continuity_counter_ = 0;
+	uint64_t tunes_ = 0;
+	uint64_t bytes_read_ = 0;
+	int32_t timer_fd_ = -1;
+	size_t read_size_ = 188 * 1024;
+	uint64_t random_state_ = 0;
+
+	void tune(int32_t freq_num, int32_t slot_num, const std::string& op);
+	uint64_t available_packets() const;
+	uint16_t transport_stream_id() const;
+	double random();
+	void sleep(std::chrono::milliseconds duration, const std::string& op) const;
+	void write_packet(uint8_t* p, uint64_t n, uint16_t tsid);
+};
+
+}
@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <atomic>
+
+namespace px4tsid
+{
+
+// cancel() is async-signal-safe and may be called from a signal handler.
+class CancelToken
+{
+public:
+	CancelToken() = default;
+	~CancelToken() = default;
+
+	void cancel() { has_cancel_ = true; }
+	void reset() { has_cancel_ = false; }
+	bool is_cancelled() const { return has_cancel_; }
+
+private:
+	std::atomic<bool> has_cancel_{false};
+	static_assert(std::atomic<bool>::is_always_lock_free);
+};
+
+}
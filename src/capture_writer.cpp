@@ -0,0 +1,148 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "capture_writer.h"
+#include "logger.h"
+
+namespace px4tsid
+{
+
+CaptureWriter::CaptureWriter(size_t buffer_size, size_t buffer_count) :
+	buffer_size_(buffer_size)
+{
+	for (size_t i = 0; i < buffer_count; i++)
+	{
+		buffers_.emplace_back(new uint8_t[buffer_size]);
+		free_.push_back(buffers_.back().get());
+	}
+	thread_ = std::thread(&CaptureWriter::run, this);
+}
+
+CaptureWriter::~CaptureWriter()
+{
+	push({ JobType::quit, "", 0, nullptr });
+	thread_.join();
+}
+
+void CaptureWriter::open(const std::string& path, size_t limit)
+{
+	push({ JobType::open, path, limit, nullptr });
+}
+
+void CaptureWriter::close()
+{
+	push({ JobType::close, "", 0, nullptr });
+}
+
+uint8_t* CaptureWriter::acquire()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (free_.empty())
+	{
+		return nullptr;
+	}
+	auto buf = free_.back();
+	free_.pop_back();
+	return buf;
+}
+
+void CaptureWriter::submit(uint8_t* buf, size_t size)
+{
+	push({ JobType::write, "", size, buf });
+}
+
+void CaptureWriter::skip(size_t size)
+{
+	push({ JobType::skip, "", size, nullptr });
+}
+
+void CaptureWriter::release(uint8_t* buf)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	free_.push_back(buf);
+	cond_.notify_all();
+}
+
+void CaptureWriter::push(const Job& job)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	jobs_.push_back(job);
+	cond_.notify_all();
+}
+
+void CaptureWriter::run()
+{
+	int32_t fd = -1;
+	std::string path;
+	size_t left = 0;
+	size_t skipped = 0;
+
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cond_.wait(lock, [this] { return !jobs_.empty(); });
+			job = jobs_.front();
+			jobs_.pop_front();
+		}
+
+		switch (job.type)
+		{
+		case JobType::open:
+			if (fd != -1) { ::close(fd); }
+			path = job.path;
+			left = job.size;
+			skipped = 0;
+			fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (fd == -1)
+			{
+				PX4TSID_LOG(LogLevel::error, "failed to open capture %s", path.c_str());
+			}
+			break;
+		case JobType::write:
+			if (fd != -1 && left > 0)
+			{
+				auto size = std::min(left, job.size);
+				if (::write(fd, job.buf, size) != static_cast<ssize_t>(size))
+				{
+					PX4TSID_LOG(LogLevel::error, "failed to write capture %s", path.c_str());
+					::close(fd);
+					fd = -1;
+				}
+				left -= size;
+			}
+			release(job.buf);
+			break;
+		case JobType::skip:
+			if (fd != -1 && left > 0)
+			{
+				skipped += job.size;
+			}
+			break;
+		case JobType::close:
+			if (fd != -1) { ::close(fd); }
+			fd = -1;
+			if (skipped > 0)
+			{
+				PX4TSID_LOG(LogLevel::warn, "capture %s skipped %zu bytes, writing fell behind", path.c_str(), skipped);
+			}
+			skipped = 0;
+			break;
+		case JobType::quit:
+			if (fd != -1) { ::close(fd); }
+			return;
+		}
+	}
+}
+
+}
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace px4tsid
+{
+
+// Writes stream buffers to a file on a background thread. The scan reads
+// into a buffer taken with acquire() and hands it over with submit(), so
+// capturing adds neither a copy nor a write() to the read path. acquire()
+// never waits for the thread: with every buffer still queued it returns
+// nullptr, the scan reads without capturing and reports the gap with skip().
+class CaptureWriter
+{
+public:
+	CaptureWriter(size_t buffer_size, size_t buffer_count = 4);
+	~CaptureWriter();
+
+	size_t buffer_size() const { return buffer_size_; }
+	void open(const std::string& path, size_t limit);
+	void close();
+	uint8_t* acquire();
+	void submit(uint8_t* buf, size_t size);
+	void skip(size_t size);
+	void release(uint8_t* buf);
+
+private:
+	enum class JobType
+	{
+		open,
+		write,
+		skip,
+		close,
+		quit,
+	};
+
+	struct Job
+	{
+		JobType type;
+		std::string path;
+		size_t size;
+		uint8_t* buf;
+	};
+
+	size_t buffer_size_;
+	std::vector<std::unique_ptr<uint8_t[]>> buffers_;
+	std::vector<uint8_t*> free_;
+	std::deque<Job> jobs_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::thread thread_;
+
+	void push(const Job& job);
+	void run();
+};
+
+}
@@ -17,7 +17,12 @@ void to_json(nlohmann::json& j, const ChSet& p)
 		{"frequency_if_khz", p.frequency_if_khz()},
 		{"has_lock", p.has_lock()},
 		{"transport_stream_id", p.transport_stream_id()},
+		{"slot_status", p.slot_status()},
 	};
+	if (!p.slot_stats().empty())
+	{
+		j["slot_stats"] = p.slot_stats();
+	}
 }
 
 void from_json(const nlohmann::json& j, ChSet& p)
@@ -28,6 +33,24 @@ void from_json(const nlohmann::json& j, ChSet& p)
 	p.set_frequency_khz(j.at("frequency_khz"));
 	p.has_lock(j.at("has_lock"));
 	p.set_transport_stream_ids(j.at("transport_stream_id"));
+	if (j.contains("slot_status"))
+	{
+		p.set_slot_statuses(j.at("slot_status"));
+	}
+	else
+	{
+		// a table written before slot_status: a TSID was found, any other slot of a locked transponder was empty
+		std::vector<SlotStatus> statuses;
+		for (auto tsid : p.transport_stream_id())
+		{
+			statuses.emplace_back(tsid != 0xffff ? SlotStatus::found : p.has_lock() ? SlotStatus::not_found : SlotStatus::unprobed);
+		}
+		p.set_slot_statuses(statuses);
+	}
+	if (j.contains("slot_stats"))
+	{
+		p.set_slot_stats(j.at("slot_stats").get<std::vector<SlotStats>>());
+	}
 }
 
 }
\ No newline at end of file
@@ -9,10 +9,28 @@
 
 #include "json.hpp"
 #include "config.h"
+#include "ts_parser.h"
 
 namespace px4tsid
 {
 
+enum class SlotStatus
+{
+	unprobed,
+	found,
+	not_found,
+	timeout,
+	error,
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(SlotStatus, {
+	{SlotStatus::unprobed, "unprobed"},
+	{SlotStatus::found, "found"},
+	{SlotStatus::not_found, "not_found"},
+	{SlotStatus::timeout, "timeout"},
+	{SlotStatus::error, "error"},
+})
+
 class ChSet
 {
 public:
@@ -21,7 +39,8 @@ public:
 		frequency_idx_(0),
 		frequency_khz_(0),
 		frequency_if_khz_(0),
-		transport_stream_id_(8, 0xffff)
+		transport_stream_id_(8, 0xffff),
+		slot_status_(8, SlotStatus::unprobed)
 	{}
 	~ChSet() = default;
 
@@ -33,6 +52,9 @@ public:
 	bool has_lock() const { return has_lock_; }
 	const std::vector<uint16_t>& transport_stream_id() const { return transport_stream_id_; }
 	uint16_t transport_stream_id(size_t slot) const { return transport_stream_id_.at(slot); }
+	const std::vector<SlotStatus>& slot_status() const { return slot_status_; }
+	SlotStatus slot_status(size_t slot) const { return slot_status_.at(slot); }
+	const std::vector<SlotStats>& slot_stats() const { return slot_stats_; }
 
 	void set_transponder(const std::string& transponder) { transponder_ = transponder; }
 	void set_number(int32_t number) { number_ = number; }
@@ -57,6 +79,30 @@ public:
 	{
 		transport_stream_id_ = tsids;
 	}
+	void set_slot_status(int32_t slot, SlotStatus status)
+	{
+		if (slot_status_.size() == 0)
+		{
+			slot_status_.resize(8, SlotStatus::unprobed);
+		}
+		slot_status_.at(slot) = status;
+	}
+	void set_slot_statuses(const std::vector<SlotStatus>& statuses)
+	{
+		slot_status_ = statuses;
+	}
+	void set_slot_stats(int32_t slot, const SlotStats& stats)
+	{
+		if (slot_stats_.size() == 0)
+		{
+			slot_stats_.resize(8);
+		}
+		slot_stats_.at(slot) = stats;
+	}
+	void set_slot_stats(const std::vector<SlotStats>& stats)
+	{
+		slot_stats_ = stats;
+	}
 
 private:
 	std::string transponder_;
@@ -66,6 +112,8 @@ private:
 	uint32_t frequency_if_khz_ = 0;
 	bool has_lock_ = false;
 	std::vector<uint16_t> transport_stream_id_;
+	std::vector<SlotStatus> slot_status_;
+	std::vector<SlotStats> slot_stats_;
 };
 
 void to_json(nlohmann::json& j, const ChSet& p);
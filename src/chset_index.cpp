@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "chset.h"
+#include "chset_index.h"
+
+namespace px4tsid
+{
+
+void ChSetIndex::build(const nlohmann::json& json)
+{
+	entries_.clear();
+	by_tsid_.clear();
+	by_slot_.clear();
+
+	for (const auto& band : {"BS", "CS"})
+	{
+		if (!json.contains(band)) continue;
+		for (const auto& c : json.at(band).get<std::vector<ChSet>>())
+		{
+			if (!c.has_lock()) continue;
+			for (size_t slot = 0; slot < c.transport_stream_id().size(); slot++)
+			{
+				auto tsid = c.transport_stream_id(slot);
+				if (tsid == 0xffff) continue;
+				Entry entry = {
+					tsid,
+					band,
+					c.transponder(),
+					c.number(),
+					c.frequency_idx(),
+					static_cast<int32_t>(slot),
+					c.frequency_khz(),
+				};
+				by_tsid_[tsid] = entries_.size();
+				by_slot_[slot_key(entry.frequency_idx, entry.slot)] = entries_.size();
+				entries_.emplace_back(entry);
+			}
+		}
+	}
+}
+
+const ChSetIndex::Entry* ChSetIndex::find_tsid(uint16_t tsid) const
+{
+	auto it = by_tsid_.find(tsid);
+	return it == by_tsid_.end() ? nullptr : &entries_.at(it->second);
+}
+
+const ChSetIndex::Entry* ChSetIndex::find_slot(int32_t frequency_idx, int32_t slot) const
+{
+	auto it = by_slot_.find(slot_key(frequency_idx, slot));
+	return it == by_slot_.end() ? nullptr : &entries_.at(it->second);
+}
+
+}
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "json.hpp"
+
+namespace px4tsid
+{
+
+class ChSetIndex
+{
+public:
+	struct Entry
+	{
+		uint16_t transport_stream_id;
+		std::string band;
+		std::string transponder;
+		int32_t number;
+		int32_t frequency_idx;
+		int32_t slot;
+		uint32_t frequency_khz;
+	};
+
+	ChSetIndex() = default;
+	~ChSetIndex() = default;
+
+	void build(const nlohmann::json& json);
+	const Entry* find_tsid(uint16_t tsid) const;
+	const Entry* find_slot(int32_t frequency_idx, int32_t slot) const;
+	const std::vector<Entry>& entries() const { return entries_; }
+	size_t size() const { return entries_.size(); }
+
+private:
+	std::vector<Entry> entries_;
+	std::unordered_map<uint16_t, size_t> by_tsid_;
+	std::unordered_map<uint32_t, size_t> by_slot_;
+
+	static uint32_t slot_key(int32_t frequency_idx, int32_t slot) { return (frequency_idx << 3) | (slot & 0x07); }
+};
+
+}
@@ -2,14 +2,17 @@
 
 #include <getopt.h>
 
+#include <cerrno>
 #include <cstdint>
 #include <algorithm>
+#include <cstdlib>
 #include <string>
 #include <stdexcept>
 #include <sstream>
 #include <unordered_set>
 
 #include "config.h"
+#include "scan_plan.h"
 
 namespace px4tsid
 {
@@ -23,10 +26,39 @@ void Config::parse(int argc, char* argv[])
 		{"ignore", required_argument, 0, 'i'},
 		{"ts-number-size", required_argument, 0, 't'},
 		{"retry-times", required_argument, 0, 'r'},
+		{"plan", required_argument, 0, 'p'},
+		{"io-timeout", required_argument, 0, 'o'},
+		{"slot-timeout", required_argument, 0, 's'},
+		{"scan-timeout", required_argument, 0, 'S'},
+		{"time-budget", required_argument, 0, 'B'},
+		{"serve", required_argument, 0, 'L'},
+		{"table", required_argument, 0, 'T'},
+		{"query", required_argument, 0, 'q'},
+		{"busy-wait", required_argument, 0, 'w'},
+		{"max-failures", required_argument, 0, 'm'},
+		{"tuners", required_argument, 0, 'N'},
+		{"hedge", no_argument, 0, 'H'},
+		{"capture-dir", required_argument, 0, 'C'},
+		{"capture-size", required_argument, 0, 'z'},
+		{"stats", no_argument, 0, 'x'},
+		{"stats-window", required_argument, 0, 'X'},
+		{"profile", required_argument, 0, 'P'},
+		{"verify", required_argument, 0, 'V'},
+		{"verify-format", required_argument, 0, 'F'},
+		{"analyze", required_argument, 0, 'A'},
+		{"probe", required_argument, 0, 'b'},
+		{"handoff", required_argument, 0, 'O'},
+		{"sweep", required_argument, 0, 'W'},
+		{"memory-budget", required_argument, 0, 'M'},
+		{"singleflight", no_argument, 0, 'G'},
+		{"delivery-system", required_argument, 0, 'D'},
+		{"quiet", no_argument, 0, 'Q'},
+		{"log-format", required_argument, 0, 'J'},
 		{0,0,0,0},
 	};
 	const std::unordered_set<std::string> formats{
 		"json",
+		"ndjson",
 		"dvbv5",
 		"dvbv5lnb",
 		"mirakurun",
@@ -42,7 +74,7 @@ void Config::parse(int argc, char* argv[])
 	while(true)
 	{
 		auto option_index = 0;
-		auto c = getopt_long(argc, argv, "hlf:i:t:r:", long_options, &option_index);
+		auto c = getopt_long(argc, argv, "hlf:i:t:r:p:o:s:S:B:L:T:q:w:m:N:HC:z:xX:P:V:F:A:D:QJ:b:O:W:M:G", long_options, &option_index);
 		if (c == -1) { break; }
 
 		switch (c)
@@ -86,6 +118,10 @@ void Config::parse(int argc, char* argv[])
 			{
 				ts_number_size_ = 8;
 			}
+			else
+			{
+				ts_number_size_ = n;
+			}
 			break;
 		}
 		case 'r':
@@ -101,6 +137,197 @@ void Config::parse(int argc, char* argv[])
 			}
 			break;
 		}
+		case 'p':
+		{
+			plan_ = optarg;
+			break;
+		}
+		case 'o':
+		{
+			auto n = std::atoi(optarg);
+			io_timeout_ = std::chrono::milliseconds(n < 1 ? 1 : n);
+			break;
+		}
+		case 's':
+		{
+			auto n = std::atoi(optarg);
+			slot_timeout_ = std::chrono::milliseconds(n < 1 ? 1 : n);
+			break;
+		}
+		case 'S':
+		{
+			auto n = std::atoi(optarg);
+			scan_timeout_ = std::chrono::seconds(n < 0 ? 0 : n);
+			break;
+		}
+		case 'B':
+		{
+			auto n = std::atoi(optarg);
+			time_budget_ = std::chrono::seconds(n < 0 ? 0 : n);
+			break;
+		}
+		case 'L':
+		{
+			serve_ = optarg;
+			break;
+		}
+		case 'T':
+		{
+			table_ = optarg;
+			break;
+		}
+		case 'q':
+		{
+			query_ = optarg;
+			break;
+		}
+		case 'w':
+		{
+			auto n = std::atoi(optarg);
+			busy_wait_ = std::chrono::seconds(n < 0 ? 0 : n);
+			break;
+		}
+		case 'm':
+		{
+			auto n = std::atoi(optarg);
+			max_failures_ = n < 1 ? 1 : n;
+			break;
+		}
+		case 'N':
+		{
+			auto n = std::atoi(optarg);
+			tuners_ = n < 1 ? 1 : n;
+			break;
+		}
+		case 'H':
+		{
+			is_hedge_ = true;
+			break;
+		}
+		case 'C':
+		{
+			capture_dir_ = optarg;
+			break;
+		}
+		case 'z':
+		{
+			auto n = std::atoi(optarg);
+			capture_size_ = static_cast<size_t>(n < 1 ? 1 : n) * 1024 * 1024;
+			break;
+		}
+		case 'x':
+		{
+			is_stats_ = true;
+			break;
+		}
+		case 'X':
+		{
+			auto n = std::atoi(optarg);
+			stats_window_ = std::chrono::milliseconds(n < 1 ? 1 : n);
+			break;
+		}
+		case 'P':
+		{
+			profile_ = optarg;
+			break;
+		}
+		case 'V':
+		{
+			verify_ = optarg;
+			break;
+		}
+		case 'F':
+		{
+			verify_format_ = optarg;
+			if (verify_format_ == "ndjson" || !formats.count(verify_format_))
+			{
+				error_ = usage(argv[0], "unknown verify format");
+				throw std::runtime_error(error_);
+			}
+			break;
+		}
+		case 'A':
+		{
+			analyze_ = optarg;
+			break;
+		}
+		case 'b':
+		{
+			char* end = nullptr;
+			auto tsid = std::strtol(optarg, &end, 0);
+			if (end == optarg || *end != '\0' || tsid < 0 || tsid >= 0xffff)
+			{
+				error_ = usage(argv[0], "invalid probe TSID");
+				throw std::runtime_error(error_);
+			}
+			probe_ = static_cast<int32_t>(tsid);
+			break;
+		}
+		case 'O':
+		{
+			handoff_ = optarg;
+			break;
+		}
+		case 'W':
+		{
+			// from-to[:step] in kHz, IF frequencies are taken as they come after the LNB
+			char* end = nullptr;
+			auto from = std::strtoul(optarg, &end, 10);
+			auto to = *end == '-' ? std::strtoul(end + 1, &end, 10) : 0;
+			auto step = *end == ':' ? std::strtoul(end + 1, &end, 10) : sweep_step_khz_;
+			if (from > 0 && from < ScanPlan::LNB_LOCAL_KHZ) { from += ScanPlan::LNB_LOCAL_KHZ; }
+			if (to > 0 && to < ScanPlan::LNB_LOCAL_KHZ) { to += ScanPlan::LNB_LOCAL_KHZ; }
+			if (*end != '\0' || from == 0 || to < from || step == 0)
+			{
+				error_ = usage(argv[0], "invalid sweep range");
+				throw std::runtime_error(error_);
+			}
+			sweep_from_khz_ = static_cast<uint32_t>(from);
+			sweep_to_khz_ = static_cast<uint32_t>(to);
+			sweep_step_khz_ = static_cast<uint32_t>(step);
+			break;
+		}
+		case 'G':
+			is_singleflight_ = true;
+			break;
+		case 'M':
+		{
+			char* end = nullptr;
+			errno = 0;
+			auto kb = std::strtol(optarg, &end, 10);
+			if (end == optarg || *end != '\0' || errno == ERANGE || kb < 0 || kb > INT32_MAX)
+			{
+				error_ = usage(argv[0], "invalid memory budget");
+				throw std::runtime_error(error_);
+			}
+			memory_budget_kb_ = static_cast<int32_t>(kb);
+			break;
+		}
+		case 'D':
+		{
+			delivery_system_ = optarg;
+			if (delivery_system_ != "isdbs" && delivery_system_ != "dvbs" && delivery_system_ != "dvbs2")
+			{
+				error_ = usage(argv[0], "unknown delivery system");
+				throw std::runtime_error(error_);
+			}
+			break;
+		}
+		case 'Q':
+		{
+			is_quiet_ = true;
+			break;
+		}
+		case 'J':
+		{
+			log_format_ = optarg;
+			if (log_format_ != "text" && log_format_ != "json")
+			{
+				error_ = usage(argv[0], "unknown log format");
+				throw std::runtime_error(error_);
+			}
+			break;
+		}
 		case 'h':
 		default:
 			error_ = usage(argv[0]);
@@ -109,12 +336,84 @@ void Config::parse(int argc, char* argv[])
 	}
 
 	argc -= optind;
-	if (argc != 1)
+	if (!handoff_.empty() && probe_ < 0)
+	{
+		error_ = usage(argv[0], "--handoff needs --probe");
+		throw std::runtime_error(error_);
+	}
+	if (!handoff_.empty() && is_hedge_)
+	{
+		// a hedge that wins reads the PAT on a tuner other than the one handed off
+		error_ = usage(argv[0], "--handoff does not work with --hedge");
+		throw std::runtime_error(error_);
+	}
+	if (!handoff_.empty() && (is_stats_ || !capture_dir_.empty()))
+	{
+		// both read each slot to its end and stop the stream, nothing is left to hand off
+		error_ = usage(argv[0], "--handoff does not work with --stats or --capture-dir");
+		throw std::runtime_error(error_);
+	}
+
+	if (memory_budget_kb_ > 0)
+	{
+		if (is_stats_ || !capture_dir_.empty())
+		{
+			error_ = usage(argv[0], "--stats and --capture-dir do not fit --memory-budget");
+			throw std::runtime_error(error_);
+		}
+		if (buffer_size() < MIN_BUFFER_SIZE)
+		{
+			error_ = usage(argv[0], "--memory-budget too small for --tuners");
+			throw std::runtime_error(error_);
+		}
+	}
+
+	if (is_sweep() && format_ != "json" && format_ != "ndjson")
+	{
+		error_ = usage(argv[0], "--sweep prints json or ndjson");
+		throw std::runtime_error(error_);
+	}
+
+	if (!query_.empty())
+	{
+		if (argc < 1)
+		{
+			error_ = usage(argv[0], "no query request");
+			throw std::runtime_error(error_);
+		}
+		for (auto i = optind; i < optind + argc; i++)
+		{
+			request_ += (i == optind ? "" : " ") + std::string(argv[i]);
+		}
+		return;
+	}
+
+	if (!analyze_.empty())
+	{
+		return;
+	}
+
+	if (!serve_.empty() && !table_.empty() && argc == 0)
+	{
+		return;
+	}
+
+	if (argc < 1)
 	{
 		error_ = usage(argv[0], "invalid number of arguments");
 		throw std::runtime_error(error_);
 	}
-	device_ = argv[optind];
+	devices_.assign(argv + optind, argv + optind + argc);
+}
+
+int32_t Config::buffer_size() const
+{
+	if (memory_budget_kb_ == 0)
+	{
+		return BUFFER_SIZE;
+	}
+	auto size = static_cast<int64_t>(memory_budget_kb_) * 1024 / tuners_ / 188 * 188;
+	return static_cast<int32_t>(std::min<int64_t>(size, BUFFER_SIZE));
 }
 
 std::string Config::usage(const std::string& argv0, const std::string& msg) const
@@ -123,18 +422,61 @@ std::string Config::usage(const std::string& argv0, const std::string& msg) cons
 
 	os << "\n"
 		<< "usage: " << argv0
-		<< " [options] DEVICE\n"
+		<< " [options] DEVICE [DEVICE...]\n"
+		<< "       " << argv0 << " --serve=socket {--table=file | [options] DEVICE [DEVICE...]}\n"
+		<< "       " << argv0 << " --query=socket {TSID tsid | SLOT frequency_idx slot}\n"
+		<< "       " << argv0 << " --analyze=file [--format=ndjson]\n"
+		<< "       " << argv0 << " --probe=TSID [--table=file] [options] DEVICE [DEVICE...]\n"
+		<< "       " << argv0 << " --sweep=kHz-kHz[:kHz] [options] DEVICE [DEVICE...]\n"
 		<< "\n"
 		<< "options:\n"
 		<< "  --help                     show this help message\n"
 		<< "  --lnb                      enable LNB power\n"
-		<< "  --format=str               chset format str={json,dvbv5,dvbv5lnb,mirakurun,\n"
+		<< "  --format=str               chset format str={json,ndjson,dvbv5,dvbv5lnb,mirakurun,\n"
 		<< "                             dvbv5tsid,dvbv5lnbtsid,mirakuruntsid,\n"
 		<< "                             bondvb,bonpt,bonptx,bonpx4}\n"
 		<< "  --ignore=TSID0,TSID1,...   ignore TSIDs\n"
 		<< "  --ts-number-size=n         scan from 0 to n realtive TS number (4) (TS0,TS1,TS2,TS3)\n"
 		<< "  --retry-times=n            retry times scan PAT (5)\n"
-		<< "  DEVICE                     px4_drv device file\n";
+		<< "  --plan=file                scan only transponders and slots listed in JSON file\n"
+		<< "  --io-timeout=ms            timeout of each tuner operation (5000)\n"
+		<< "  --slot-timeout=ms          time budget of each slot (10000)\n"
+		<< "  --scan-timeout=sec         time budget of the whole scan (0: unlimited)\n"
+		<< "  --time-budget=sec          like --scan-timeout, but slots the last scan found populated go first,\n"
+		<< "                             slots it found empty last\n"
+		<< "  --serve=socket             answer TSID lookups on unix domain socket\n"
+		<< "  --table=file               serve TSID table file (json) instead of scanning,\n"
+		<< "                             or the map --probe looks the TSID up in\n"
+		<< "  --query=socket             send lookup request to px4tsid --serve\n"
+		<< "  --busy-wait=sec            wait for an idle tuner when all DEVICEs are busy (30)\n"
+		<< "  --max-failures=n           mark a tuner unhealthy after n failures (3)\n"
+		<< "  --tuners=n                 scan with up to n idle DEVICEs at once (1)\n"
+		<< "  --memory-budget=KB         stream buffers of all tuners share KB, log peak RSS at the end\n"
+		<< "                             (" << DEFAULT_MEMORY_BUDGET_KB << ", 0: " << BUFFER_SIZE / 1024 << "KB per tuner)\n"
+		<< "  --singleflight             share one scan with px4tsid started on the same DEVICEs meanwhile,\n"
+		<< "                             wait for its result instead of scanning again\n"
+		<< "  --hedge                    retune a slow slot on a tuner left idle at the end of --tuners scan\n"
+		<< "  --capture-dir=dir          save stream read from each slot to dir\n"
+		<< "  --capture-size=MB          save at most MB per slot (1), reading stops at the PAT\n"
+		<< "                             (or the end of --stats-window) anyway\n"
+		<< "  --stats                    add per-PID packet, continuity error and bitrate stats\n"
+		<< "  --stats-window=ms          with --stats, read each slot this long from the start of the stream\n"
+		<< "                             even after its PAT, within --slot-timeout (1000)\n"
+		<< "  --profile=file             learn slot timings in file and use them for deadlines and order\n"
+		<< "  --verify=file              tune only the channels in file and report stale ones\n"
+		<< "  --verify-format=str        format of --verify file (json), same names as --format\n"
+		<< "  --analyze=file             list PAT TSID/version changes in recorded TS file\n"
+		<< "  --probe=TSID               check that TSID is where --table (or the last scan) has it,\n"
+		<< "                             exit 0 if it is, 2 if it moved, 3 if not found\n"
+		<< "  --handoff=socket           pass the tuner streaming the --probe TSID to the process\n"
+		<< "                             listening on unix domain socket (px4_drv DEVICE only)\n"
+		<< "  --sweep=from-to[:step]     blind scan satellite frequencies in kHz (step 2000) and list\n"
+		<< "                             the carriers that lock with their TSIDs (json, ndjson)\n"
+		<< "  --quiet                    log errors only, no progress\n"
+		<< "  --log-format=str           progress log on stderr str={text,json} (text)\n"
+		<< "  --delivery-system=str      delivery system of DVB DEVICE str={isdbs,dvbs,dvbs2} (isdbs)\n"
+		<< "  DEVICE                     px4_drv device file or DVB adapter /dev/dvb/adapterN,\n"
+		<< "                             the first idle one is used\n";
 
 	if (!msg.empty())
 	{
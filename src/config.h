@@ -3,8 +3,10 @@
 #pragma once
 
 #include <cstdint>
+#include <chrono>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 namespace px4tsid
 {
@@ -17,27 +19,122 @@ public:
 
 	const std::string& format() const { return format_; }
 	const std::string& error() const { return error_; }
-	const std::string& device() const { return device_; }
+	const std::string& device() const { return devices_.at(0); }
+	const std::vector<std::string>& devices() const { return devices_; }
 	bool lnb_power() const { return lnb_power_; }
 	bool is_ignore_tsid(uint16_t tsid) const { return ignore_tsids_.count(tsid) ? true : false;}
-	int32_t transponder_size_bs() const { return TRANSPONDER_SIZE_BS; }
-	int32_t transponder_size_cs() const { return TRANSPONDER_SIZE_CS; }
-	int32_t buffer_size() const { return BUFFER_SIZE; }
+	const std::string& plan() const { return plan_; }
+	const std::string& serve() const { return serve_; }
+	const std::string& table() const { return table_; }
+	const std::string& query() const { return query_; }
+	const std::string& request() const { return request_; }
+	// read buffer of each tuner, with --memory-budget the tuners share the budget
+	int32_t buffer_size() const;
+	// reads one of --retry-times takes, so that a smaller buffer still covers a PAT interval
+	int32_t reads_per_retry() const { return (BUFFER_SIZE + buffer_size() - 1) / buffer_size(); }
+	int32_t memory_budget_kb() const { return memory_budget_kb_; }
 	int32_t ts_number_size() const { return ts_number_size_; }
 	int32_t retry_count() const { return retry_count_; }
+	std::chrono::milliseconds io_timeout() const { return io_timeout_; }
+	std::chrono::milliseconds slot_timeout() const { return slot_timeout_; }
+	std::chrono::seconds scan_timeout() const { return scan_timeout_; }
+	std::chrono::seconds time_budget() const { return time_budget_; }
+	std::chrono::seconds busy_wait() const { return busy_wait_; }
+	int32_t max_failures() const { return max_failures_; }
+	int32_t tuners() const { return tuners_; }
+	bool is_hedge() const { return is_hedge_; }
+	bool is_singleflight() const { return is_singleflight_; }
+	const std::string& capture_dir() const { return capture_dir_; }
+	size_t capture_size() const { return capture_size_; }
+	bool is_stats() const { return is_stats_; }
+	std::chrono::milliseconds stats_window() const { return stats_window_; }
+	const std::string& profile() const { return profile_; }
+	const std::string& verify() const { return verify_; }
+	const std::string& verify_format() const { return verify_format_; }
+	const std::string& analyze() const { return analyze_; }
+	int32_t probe() const { return probe_; }
+	const std::string& handoff() const { return handoff_; }
+	bool is_sweep() const { return sweep_to_khz_ > 0; }
+	uint32_t sweep_from_khz() const { return sweep_from_khz_; }
+	uint32_t sweep_to_khz() const { return sweep_to_khz_; }
+	uint32_t sweep_step_khz() const { return sweep_step_khz_; }
+	const std::string& delivery_system() const { return delivery_system_; }
+	bool is_quiet() const { return is_quiet_; }
+	const std::string& log_format() const { return log_format_; }
 	void parse(int argc, char* argv[]);
 
+	void set_device(const std::string& device) { devices_ = { device }; }
+	void set_devices(const std::vector<std::string>& devices) { devices_ = devices; }
+	void set_busy_wait(std::chrono::seconds wait) { busy_wait_ = wait; }
+	void set_max_failures(int32_t count) { max_failures_ = count; }
+	void set_tuners(int32_t count) { tuners_ = count; }
+	void set_hedge(bool is_enable) { is_hedge_ = is_enable; }
+	void set_singleflight(bool is_enable) { is_singleflight_ = is_enable; }
+	void set_capture_dir(const std::string& dir) { capture_dir_ = dir; }
+	void set_capture_size(size_t size) { capture_size_ = size; }
+	void set_stats(bool is_enable) { is_stats_ = is_enable; }
+	void set_stats_window(std::chrono::milliseconds window) { stats_window_ = window; }
+	void set_profile(const std::string& profile) { profile_ = profile; }
+	void set_delivery_system(const std::string& system) { delivery_system_ = system; }
+	void set_verify(const std::string& verify, const std::string& format) { verify_ = verify; verify_format_ = format; }
+	void set_plan(const std::string& plan) { plan_ = plan; }
+	void set_lnb_power(bool is_enable) { lnb_power_ = is_enable; }
+	void set_ignore_tsid(uint16_t tsid) { ignore_tsids_.emplace(tsid); }
+	void set_ts_number_size(int32_t size) { ts_number_size_ = size; }
+	void set_retry_count(int32_t count) { retry_count_ = count; }
+	void set_io_timeout(std::chrono::milliseconds timeout) { io_timeout_ = timeout; }
+	void set_slot_timeout(std::chrono::milliseconds timeout) { slot_timeout_ = timeout; }
+	void set_scan_timeout(std::chrono::seconds timeout) { scan_timeout_ = timeout; }
+	void set_time_budget(std::chrono::seconds budget) { time_budget_ = budget; }
+	void set_memory_budget_kb(int32_t budget) { memory_budget_kb_ = budget; }
+
 private:
-	static constexpr int32_t TRANSPONDER_SIZE_BS = 12;
-	static constexpr int32_t TRANSPONDER_SIZE_CS = 12;
 	static constexpr int32_t BUFFER_SIZE = 188*1024;
+	static constexpr int32_t MIN_BUFFER_SIZE = 188*8;
+#if defined(PX4TSID_LOW_MEMORY)
+	static constexpr int32_t DEFAULT_MEMORY_BUDGET_KB = 64;
+#else
+	static constexpr int32_t DEFAULT_MEMORY_BUDGET_KB = 0;
+#endif
 
 	std::string format_ = "json";
 	std::string error_;
-	std::string device_;
+	std::vector<std::string> devices_;
+	std::string plan_;
+	std::string serve_;
+	std::string table_;
+	std::string query_;
+	std::string request_;
 	bool lnb_power_ = false;
 	int32_t ts_number_size_ = 4;
 	int32_t retry_count_ = 5;
+	std::chrono::milliseconds io_timeout_{5000};
+	std::chrono::milliseconds slot_timeout_{10000};
+	std::chrono::seconds scan_timeout_{0};
+	std::chrono::seconds time_budget_{0};
+	std::chrono::seconds busy_wait_{30};
+	int32_t max_failures_ = 3;
+	int32_t tuners_ = 1;
+	int32_t memory_budget_kb_ = DEFAULT_MEMORY_BUDGET_KB;
+	bool is_hedge_ = false;
+	bool is_singleflight_ = false;
+	std::string capture_dir_;
+	// a slot stops reading at its PAT (or the --stats window) or after --retry-times reads, well below 1MB by default
+	size_t capture_size_ = 1 * 1024 * 1024;
+	bool is_stats_ = false;
+	std::chrono::milliseconds stats_window_{1000};
+	std::string profile_;
+	std::string verify_;
+	std::string verify_format_ = "json";
+	std::string analyze_;
+	int32_t probe_ = -1;
+	std::string handoff_;
+	uint32_t sweep_from_khz_ = 0;
+	uint32_t sweep_to_khz_ = 0;
+	uint32_t sweep_step_khz_ = 2000;
+	std::string delivery_system_ = "isdbs";
+	bool is_quiet_ = false;
+	std::string log_format_ = "text";
 	std::unordered_set<uint16_t> ignore_tsids_;
 
 	std::string usage(const std::string& argv0, const std::string& msg = "") const;
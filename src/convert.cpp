@@ -6,6 +6,7 @@
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <vector>
 
 #include "json.hpp"
 
@@ -31,6 +32,40 @@ std::string Convert::json(const nlohmann::json& json)
 	return json.dump(4);
 }
 
+std::string Convert::ndjson(const nlohmann::json& json)
+{
+	std::ostringstream os;
+
+	for (const auto& band : {"BS", "CS"})
+	{
+		for (const auto& c : json.at(band).get<std::vector<ChSet>>())
+		{
+			for (size_t tsnum = 0; tsnum < c.transport_stream_id().size(); tsnum++)
+			{
+				auto tsid = c.transport_stream_id(tsnum);
+				auto status = tsnum < c.slot_status().size() ? c.slot_status(tsnum) : SlotStatus::unprobed;
+				if (status == SlotStatus::unprobed && tsid == 0xffff) continue;
+				// same keys as the lines streamed during a scan, the table does not keep the elapsed time
+				auto j = nlohmann::json{
+					{"band", band},
+					{"transponder", c.transponder()},
+					{"number", c.number()},
+					{"frequency_idx", c.frequency_idx()},
+					{"frequency_khz", c.frequency_khz()},
+					{"slot", tsnum},
+					{"transport_stream_id", tsid},
+					{"status", status},
+					{"elapsed_ms", nullptr},
+					{"stats", tsnum < c.slot_stats().size() ? nlohmann::json(c.slot_stats().at(tsnum)) : nlohmann::json()},
+				};
+				os << j.dump() << '\n';
+			}
+		}
+	}
+
+	return os.str();
+}
+
 std::string Convert::libdvbv5(const nlohmann::json& json)
 {
 	std::ostringstream os;
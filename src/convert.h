@@ -24,6 +24,7 @@ public:
 
 private:
 	static std::string json(const nlohmann::json& json);
+	static std::string ndjson(const nlohmann::json& json);
 	static std::string libdvbv5(const nlohmann::json& json);
 	static std::string libdvbv5lnb(const nlohmann::json& json);
 	static std::string mirakurun(const nlohmann::json& json);
@@ -38,6 +39,7 @@ private:
 	static const inline std::unordered_map<std::string, std::function<std::string(const nlohmann::json&)>> convert_
 	{
 		{"json", Convert::json},
+		{"ndjson", Convert::ndjson},
 		{"dvbv5", Convert::libdvbv5},
 		{"dvbv5lnb", Convert::libdvbv5lnb},
 		{"mirakurun", Convert::mirakurun},
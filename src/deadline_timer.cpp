@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+#include "deadline_timer.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace px4tsid
+{
+
+namespace
+{
+
+void deadline_handler(int signum) {}
+
+::timespec to_timespec(std::chrono::nanoseconds ns)
+{
+	::timespec ts;
+	ts.tv_sec = ns.count() / 1000000000;
+	ts.tv_nsec = ns.count() % 1000000000;
+	return ts;
+}
+
+// created on the first call of a thread instead of on every call
+class ThreadTimer
+{
+public:
+	ThreadTimer()
+	{
+		static std::once_flag once;
+		std::call_once(once, [] {
+			struct ::sigaction sa;
+			std::memset(&sa, 0, sizeof(sa));
+			sa.sa_handler = deadline_handler;
+			sigemptyset(&sa.sa_mask);
+			sigaction(SIGRTMIN, &sa, nullptr);
+		});
+
+		struct ::sigevent sev;
+		std::memset(&sev, 0, sizeof(sev));
+		sev.sigev_notify = SIGEV_THREAD_ID;
+		sev.sigev_signo = SIGRTMIN;
+		sev.sigev_notify_thread_id = ::gettid();
+		if (::timer_create(CLOCK_MONOTONIC, &sev, &timer_) == -1)
+		{
+			throw std::runtime_error("failed to timer_create");
+		}
+	}
+	~ThreadTimer()
+	{
+		::timer_delete(timer_);
+	}
+
+	// a zero value disarms
+	void arm(std::chrono::nanoseconds value, std::chrono::nanoseconds interval)
+	{
+		struct ::itimerspec its;
+		its.it_value = to_timespec(value);
+		its.it_interval = to_timespec(interval);
+		::timer_settime(timer_, 0, &its, nullptr);
+	}
+
+private:
+	timer_t timer_;
+};
+
+ThreadTimer& thread_timer()
+{
+	thread_local ThreadTimer timer;
+	return timer;
+}
+
+}
+
+DeadlineTimer::DeadlineTimer(std::chrono::milliseconds timeout)
+	: deadline_(std::chrono::steady_clock::now() + timeout)
+{
+	thread_timer().arm(std::max<std::chrono::nanoseconds>(timeout, std::chrono::nanoseconds(1)), RESEND_INTERVAL);
+}
+
+DeadlineTimer::~DeadlineTimer()
+{
+	thread_timer().arm(std::chrono::nanoseconds(0), std::chrono::nanoseconds(0));
+}
+
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <time.h>
+
+#include <cerrno>
+#include <chrono>
+#include <string>
+
+#include "trace.h"
+#include "tuner.h"
+
+namespace px4tsid
+{
+
+// Sends a signal to the calling thread when the timeout expires, so that a
+// driver sleeping in ioctl/open/read returns EINTR instead of hanging. The
+// signal repeats until the timer is destroyed, in case it arrived just
+// before the call started to sleep. Each thread re-arms one timer.
+class DeadlineTimer
+{
+public:
+	static constexpr std::chrono::milliseconds RESEND_INTERVAL{10};
+
+	explicit DeadlineTimer(std::chrono::milliseconds timeout);
+	~DeadlineTimer();
+
+	bool expired() const { return std::chrono::steady_clock::now() >= deadline_; }
+
+private:
+	std::chrono::steady_clock::time_point deadline_;
+};
+
+template <typename F>
+auto call_with_timeout(std::chrono::milliseconds timeout, const std::string& op, F&& f)
+{
+	DeadlineTimer timer(timeout);
+	PX4TSID_TRACE(op__start, op.c_str());
+	while (true)
+	{
+		auto ret = f();
+		if (ret != -1 || errno != EINTR)
+		{
+			PX4TSID_TRACE(op__done, op.c_str(), static_cast<long>(ret), errno);
+			return ret;
+		}
+		if (timer.expired())
+		{
+			PX4TSID_TRACE(op__timeout, op.c_str());
+			throw TimeoutError(op + " timed out");
+		}
+	}
+}
+
+}
@@ -0,0 +1,486 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <fcntl.h>
+#include <linux/dvb/dmx.h>
+#include <linux/dvb/frontend.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "deadline_timer.h"
+#include "dvb_device.h"
+#include "scan_plan.h"
+#include "trace.h"
+
+namespace px4tsid
+{
+
+void DVBDevice::set_delivery_system(const std::string& system)
+{
+	if (system == "isdbs")
+	{
+		delivery_system_ = SYS_ISDBS;
+	}
+	else if (system == "dvbs")
+	{
+		delivery_system_ = SYS_DVBS;
+	}
+	else if (system == "dvbs2")
+	{
+		delivery_system_ = SYS_DVBS2;
+	}
+	else
+	{
+		throw std::runtime_error("unknown delivery system " + system);
+	}
+}
+
+int32_t DVBDevice::open_node(const std::string& node, int32_t flags)
+{
+	auto fd = call_with_timeout(time_left("open"), "open", [&] {
+		return ::open(node.c_str(), flags | O_CLOEXEC);
+	});
+	if (fd == -1)
+	{
+		auto is_busy = errno == EBUSY;
+		std::ostringstream os;
+		os << "failed to open tuner " << node;
+		if (is_busy)
+		{
+			throw BusyError(os.str());
+		}
+		throw std::runtime_error(os.str());
+	}
+	return fd;
+}
+
+void DVBDevice::open_tuner(const std::string& device)
+{
+	if (frontend_fd_ != -1)
+	{
+		close_tuner();
+	}
+
+	PX4TSID_TRACE(open__start, device.c_str());
+	try
+	{
+		frontend_fd_ = open_node(device + "/frontend0", O_RDWR | O_NONBLOCK);
+		demux_fd_ = open_node(device + "/demux0", O_RDWR | O_NONBLOCK);
+		// O_NONBLOCK also makes dvb_vb2 hand over partially filled buffers
+		dvr_fd_ = open_node(device + "/dvr0", O_RDONLY | O_NONBLOCK);
+	}
+	catch (const std::exception&)
+	{
+		close_tuner();
+		throw;
+	}
+
+	device_ = device;
+	map_buffers();
+	PX4TSID_TRACE(open__done, device.c_str(), frontend_fd_);
+}
+
+bool DVBDevice::lock_tuner()
+{
+	if (frontend_fd_ == -1)
+	{
+		throw std::runtime_error("no open device");
+	}
+
+	return ::flock(frontend_fd_, LOCK_EX | LOCK_NB) == 0;
+}
+
+void DVBDevice::close_tuner()
+{
+	if (frontend_fd_ != -1 && demux_fd_ != -1)
+	{
+		stop_streaming();
+	}
+
+	if (frontend_fd_ != -1 && lnb_power_state_)
+	{
+		try
+		{
+			call_with_timeout(timeout_, "ioctl(FE_SET_VOLTAGE)", [&] {
+				return ::ioctl(frontend_fd_, FE_SET_VOLTAGE, SEC_VOLTAGE_OFF);
+			});
+		}
+		catch (const TimeoutError&)
+		{
+		}
+		lnb_power_state_ = false;
+	}
+
+	unmap_buffers();
+	for (auto fd : { &dvr_fd_, &demux_fd_, &frontend_fd_ })
+	{
+		if (*fd != -1)
+		{
+			::close(*fd);
+			*fd = -1;
+		}
+	}
+	device_.clear();
+}
+
+void DVBDevice::set_channel_s(int32_t freq_num, int32_t slot_num)
+{
+	if (frontend_fd_ == -1)
+	{
+		throw std::runtime_error("no open device");
+	}
+
+	PX4TSID_TRACE(tune__start, freq_num, slot_num);
+	if (!tune(ScanPlan::frequency_khz(freq_num), slot_num))
+	{
+		std::ostringstream os;
+		os << "failed to ioctl(FE_SET_PROPERTY) freq: " << freq_num << " slot: " << slot_num;
+		throw std::runtime_error(os.str());
+	}
+	PX4TSID_TRACE(tune__done, freq_num, slot_num);
+}
+
+void DVBDevice::set_frequency_s(uint32_t frequency_khz, int32_t slot_num)
+{
+	if (frontend_fd_ == -1)
+	{
+		throw std::runtime_error("no open device");
+	}
+
+	PX4TSID_TRACE(tune_khz__start, frequency_khz, slot_num);
+	if (!tune(frequency_khz, slot_num))
+	{
+		std::ostringstream os;
+		os << "failed to ioctl(FE_SET_PROPERTY) freq: " << frequency_khz << "kHz slot: " << slot_num;
+		throw std::runtime_error(os.str());
+	}
+	PX4TSID_TRACE(tune_khz__done, frequency_khz, slot_num);
+}
+
+bool DVBDevice::tune(uint32_t frequency_khz, int32_t slot_num)
+{
+	if (lnb_power_ && !lnb_power_state_)
+	{
+		auto ret = call_with_timeout(time_left("ioctl(FE_SET_VOLTAGE)"), "ioctl(FE_SET_VOLTAGE)", [&] {
+			return ::ioctl(frontend_fd_, FE_SET_VOLTAGE, SEC_VOLTAGE_18);
+		});
+		if (ret == -1)
+		{
+			throw std::runtime_error("failed to ioctl(FE_SET_VOLTAGE)");
+		}
+		lnb_power_state_ = true;
+	}
+
+	::dtv_property props[6] = {
+		{ DTV_CLEAR, {}, { 0 }, 0 },
+		{ DTV_DELIVERY_SYSTEM, {}, { delivery_system_ }, 0 },
+		{ DTV_FREQUENCY, {}, { frequency_khz - ScanPlan::LNB_LOCAL_KHZ }, 0 },
+	};
+	uint32_t size = 3;
+	if (delivery_system_ == SYS_ISDBS)
+	{
+		props[size++] = { DTV_STREAM_ID, {}, { static_cast<uint32_t>(slot_num) }, 0 };
+	}
+	else
+	{
+		props[size++] = { DTV_SYMBOL_RATE, {}, { 28860000 }, 0 };
+		props[size++] = { DTV_INVERSION, {}, { INVERSION_AUTO }, 0 };
+	}
+	props[size++] = { DTV_TUNE, {}, { 0 }, 0 };
+
+	::dtv_properties dtv = { size, props };
+	auto ret = call_with_timeout(time_left("ioctl(FE_SET_PROPERTY)"), "ioctl(FE_SET_PROPERTY)", [&] {
+		return ::ioctl(frontend_fd_, FE_SET_PROPERTY, &dtv);
+	});
+	if (ret == -1)
+	{
+		return false;
+	}
+
+	wait_lock();
+	if (has_streaming_)
+	{
+		// the demux kept running, discard what was queued before the retune
+		drain();
+	}
+	return true;
+}
+
+void DVBDevice::wait_lock()
+{
+	using namespace std::chrono_literals;
+	while (true)
+	{
+		::fe_status_t status = {};
+		auto ret = call_with_timeout(time_left("ioctl(FE_READ_STATUS)"), "ioctl(FE_READ_STATUS)", [&] {
+			return ::ioctl(frontend_fd_, FE_READ_STATUS, &status);
+		});
+		if (ret == -1)
+		{
+			throw std::runtime_error("failed to ioctl(FE_READ_STATUS)");
+		}
+		if (status & FE_HAS_LOCK)
+		{
+			return;
+		}
+		std::this_thread::sleep_for(std::min<std::chrono::milliseconds>(20ms, time_left("lock")));
+	}
+}
+
+void DVBDevice::start_streaming()
+{
+	if (frontend_fd_ == -1)
+	{
+		throw std::runtime_error("no open device");
+	}
+
+	if (!has_streaming_)
+	{
+		::dmx_pes_filter_params filter;
+		std::memset(&filter, 0, sizeof(filter));
+		filter.pid = is_pat_only_ ? 0x0000 : 0x2000;
+		filter.input = DMX_IN_FRONTEND;
+		filter.output = DMX_OUT_TS_TAP;
+		filter.pes_type = DMX_PES_OTHER;
+		filter.flags = DMX_IMMEDIATE_START;
+		auto ret = call_with_timeout(time_left("ioctl(DMX_SET_PES_FILTER)"), "ioctl(DMX_SET_PES_FILTER)", [&] {
+			return ::ioctl(demux_fd_, DMX_SET_PES_FILTER, &filter);
+		});
+		if (ret == -1)
+		{
+			throw std::runtime_error("failed to ioctl(DMX_SET_PES_FILTER)");
+		}
+		has_streaming_ = true;
+		PX4TSID_TRACE(stream__start);
+	}
+}
+
+void DVBDevice::stop_streaming()
+{
+	if (frontend_fd_ == -1)
+	{
+		throw std::runtime_error("no open device");
+	}
+
+	if (has_streaming_)
+	{
+		// always gets the full timeout so that an expired slot deadline does not skip the cleanup
+		try
+		{
+			call_with_timeout(timeout_, "ioctl(DMX_STOP)", [&] {
+				return ::ioctl(demux_fd_, DMX_STOP);
+			});
+		}
+		catch (const TimeoutError&)
+		{
+		}
+		// packets of this slot must not be read as the next one
+		drain();
+		has_streaming_ = false;
+		PX4TSID_TRACE(stream__stop);
+	}
+}
+
+ssize_t DVBDevice::read_stream(uint8_t* buf, size_t size)
+{
+	if (!buffers_.empty() && size < buffers_.front().length)
+	{
+		// a dequeued buffer goes back whole, the rest would be lost mid-packet
+		throw std::logic_error(device_ + " : read buffer smaller than the DMX buffer");
+	}
+
+	auto ret = wait_stream(size);
+	if (ret <= 0)
+	{
+		return ret;
+	}
+
+	ssize_t size_read;
+	if (!buffers_.empty())
+	{
+		const uint8_t* data;
+		size_read = dequeue(data);
+		if (size_read > 0)
+		{
+			std::memcpy(buf, data, size_read);
+			requeue();
+		}
+	}
+	else
+	{
+		size_read = call_with_timeout(time_left("read"), "read", [&] {
+			return ::read(dvr_fd_, buf, size);
+		});
+		// EOVERFLOW drops what the kernel buffer could not hold, the next read goes on
+		if (size_read == -1 && (errno == EAGAIN || errno == EOVERFLOW))
+		{
+			size_read = 0;
+		}
+	}
+	PX4TSID_TRACE(read__done, static_cast<long>(size_read));
+	return size_read;
+}
+
+ssize_t DVBDevice::view_stream(const uint8_t*& data)
+{
+	if (buffers_.empty())
+	{
+		throw std::logic_error(device_ + " : no mapped DMX buffers");
+	}
+	release_stream();
+
+	auto ret = wait_stream(buffers_.front().length);
+	if (ret <= 0)
+	{
+		return ret;
+	}
+
+	auto size_read = dequeue(data);
+	PX4TSID_TRACE(read__done, static_cast<long>(size_read));
+	return size_read;
+}
+
+void DVBDevice::release_stream()
+{
+	if (dequeued_ != -1)
+	{
+		requeue();
+	}
+}
+
+ssize_t DVBDevice::wait_stream(size_t size)
+{
+	if (frontend_fd_ == -1)
+	{
+		throw std::runtime_error("no open device");
+	}
+
+	if (!has_streaming_)
+	{
+		return -ENODATA;
+	}
+
+	auto timeout = time_left("read");
+	PX4TSID_TRACE(read__start, size);
+	::pollfd pfd = { dvr_fd_, POLLIN, 0 };
+	auto ret = ::poll(&pfd, 1, timeout.count());
+	if (ret == 0)
+	{
+		PX4TSID_TRACE(read__timeout);
+		throw TimeoutError("read timed out");
+	}
+	if (ret == -1)
+	{
+		PX4TSID_TRACE(read__done, 0L);
+		return 0;
+	}
+	return 1;
+}
+
+void DVBDevice::map_buffers()
+{
+	::dmx_requestbuffers req = { BUFFER_COUNT, BUFFER_SIZE };
+	if (!is_mapped_ || ::ioctl(dvr_fd_, DMX_REQBUFS, &req) == -1 || req.count == 0)
+	{
+		// kernel without CONFIG_DVB_MMAP or --memory-budget, read() instead
+		::ioctl(dvr_fd_, DMX_SET_BUFFER_SIZE, BUFFER_SIZE * BUFFER_COUNT);
+		return;
+	}
+
+	for (uint32_t i = 0; i < req.count; i++)
+	{
+		::dmx_buffer b;
+		std::memset(&b, 0, sizeof(b));
+		b.index = i;
+		if (::ioctl(dvr_fd_, DMX_QUERYBUF, &b) == -1)
+		{
+			unmap_buffers();
+			throw std::runtime_error("failed to ioctl(DMX_QUERYBUF)");
+		}
+		auto addr = ::mmap(nullptr, b.length, PROT_READ, MAP_SHARED, dvr_fd_, b.offset);
+		if (addr == MAP_FAILED)
+		{
+			unmap_buffers();
+			throw std::runtime_error("failed to mmap dvr buffer");
+		}
+		buffers_.push_back({ static_cast<uint8_t*>(addr), b.length });
+		if (::ioctl(dvr_fd_, DMX_QBUF, &b) == -1)
+		{
+			unmap_buffers();
+			throw std::runtime_error("failed to ioctl(DMX_QBUF)");
+		}
+	}
+}
+
+void DVBDevice::unmap_buffers()
+{
+	for (const auto& b : buffers_)
+	{
+		::munmap(b.data, b.length);
+	}
+	buffers_.clear();
+	dequeued_ = -1;
+}
+
+ssize_t DVBDevice::dequeue(const uint8_t*& data)
+{
+	::dmx_buffer b;
+	std::memset(&b, 0, sizeof(b));
+	if (::ioctl(dvr_fd_, DMX_DQBUF, &b) == -1)
+	{
+		return errno == EAGAIN ? 0 : -1;
+	}
+
+	dequeued_ = b.index;
+	data = buffers_.at(b.index).data;
+	return b.bytesused;
+}
+
+void DVBDevice::requeue()
+{
+	::dmx_buffer q;
+	std::memset(&q, 0, sizeof(q));
+	q.index = dequeued_;
+	::ioctl(dvr_fd_, DMX_QBUF, &q);
+	dequeued_ = -1;
+}
+
+void DVBDevice::drain()
+{
+	// what is read is thrown away, mapped buffers are requeued without a look at them
+	if (!buffers_.empty())
+	{
+		release_stream();
+		const uint8_t* data;
+		while (dequeue(data) > 0)
+		{
+			requeue();
+		}
+		return;
+	}
+
+	uint8_t buf[DRAIN_SIZE];
+
+	while (true)
+	{
+		auto ret = ::read(dvr_fd_, buf, sizeof(buf));
+		if (ret > 0) continue;
+		if (ret == -1 && errno == EOVERFLOW) continue;
+		break;
+	}
+}
+
+}
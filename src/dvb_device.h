@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <linux/dvb/frontend.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "tuner.h"
+
+namespace px4tsid
+{
+
+// Tuner on the Linux DVB API, DEVICE is the adapter directory /dev/dvb/adapterN.
+// ISDB-S slots are selected by DTV_STREAM_ID (0-7 is the relative TS number).
+class DVBDevice : public Tuner
+{
+public:
+	DVBDevice() = default;
+	~DVBDevice() override { DVBDevice::close_tuner(); }
+
+	static bool is_dvb_device(const std::string& device) { return device.compare(0, 9, "/dev/dvb/") == 0; }
+
+	void set_delivery_system(const std::string& system);
+	// false reads the kernel buffer with read() instead of mapping BUFFER_COUNT buffers into the process
+	void set_mapped_buffers(bool is_enable) { is_mapped_ = is_enable; }
+	void set_lnb_power(bool is_enable) override { lnb_power_ = is_enable; }
+	bool has_straming() const override { return has_streaming_; }
+	const std::string& device() const override { return device_; }
+	bool is_open() const override { return frontend_fd_ != -1; }
+	void open_tuner(const std::string& device) override;
+	bool lock_tuner() override;
+	void close_tuner() override;
+	void set_channel_s(int32_t freq_num, int32_t slot_num) override;
+	void set_frequency_s(uint32_t frequency_khz, int32_t slot_num) override;
+	void start_streaming() override;
+	void stop_streaming() override;
+	// a caller buffer smaller than a mapped DMX buffer is a logic_error
+	ssize_t read_stream(uint8_t* buf, size_t size) override;
+	bool has_stream_view() const override { return !buffers_.empty(); }
+	ssize_t view_stream(const uint8_t*& data) override;
+	void release_stream() override;
+	void set_pat_only(bool is_enable) override { is_pat_only_ = is_enable; }
+	int32_t poll_fd() override { return has_streaming_ ? dvr_fd_ : -1; }
+
+private:
+	struct Buffer
+	{
+		uint8_t* data;
+		size_t length;
+	};
+
+	static constexpr uint32_t BUFFER_COUNT = 16;
+	static constexpr uint32_t BUFFER_SIZE = 188 * 1024;
+	static constexpr size_t DRAIN_SIZE = 188 * 16;
+
+	std::string device_;
+	uint32_t delivery_system_ = SYS_ISDBS;
+	int32_t frontend_fd_ = -1;
+	int32_t demux_fd_ = -1;
+	int32_t dvr_fd_ = -1;
+	bool lnb_power_ = false;
+	bool lnb_power_state_ = false;
+	bool has_streaming_ = false;
+	bool is_pat_only_ = true;
+	bool is_mapped_ = true;
+	std::vector<Buffer> buffers_;
+	int32_t dequeued_ = -1;	// index of the buffer view_stream() handed out
+
+	int32_t open_node(const std::string& node, int32_t flags);
+	void map_buffers();
+	void unmap_buffers();
+	void drain();
+	bool tune(uint32_t frequency_khz, int32_t slot_num);
+	void wait_lock();
+	ssize_t wait_stream(size_t size);
+	ssize_t dequeue(const uint8_t*& data);
+	void requeue();
+};
+
+}
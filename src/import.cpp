@@ -0,0 +1,420 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "chset.h"
+#include "chset_index.h"
+#include "import.h"
+#include "scan_plan.h"
+
+namespace px4tsid
+{
+
+namespace
+{
+
+std::string trim(const std::string& s)
+{
+	auto begin = s.find_first_not_of(" \t\r\n'\"");
+	if (begin == std::string::npos) { return ""; }
+	auto end = s.find_last_not_of(" \t\r\n'\"");
+	return s.substr(begin, end - begin + 1);
+}
+
+int32_t to_int(const std::string& s)
+{
+	char* end = nullptr;
+	auto value = std::strtol(s.c_str(), &end, 0);
+	if (s.empty() || *end != '\0')
+	{
+		throw std::runtime_error("invalid number " + s);
+	}
+	return static_cast<int32_t>(value);
+}
+
+// BS01_0, BS01/TS0 -> frequency_idx 0, ND02, CS2 -> 12
+int32_t frequency_idx_from_name(const std::string& name)
+{
+	static const std::regex re(R"(^(BS|ND|CS)0*(\d+))");
+	std::smatch m;
+	if (!std::regex_search(name, m, re)) { return -1; }
+	auto number = std::stoi(m[2]);
+	if (m[1] == "BS")
+	{
+		return (number - 1) / 2;
+	}
+	return ScanPlan::TRANSPONDER_SIZE_BS + number / 2 - 1;
+}
+
+int32_t slot_from_name(const std::string& name, int32_t frequency_idx)
+{
+	static const std::regex re(R"((?:_|/TS)(\d+)$)");
+	std::smatch m;
+	if (std::regex_search(name, m, re))
+	{
+		return std::stoi(m[1]);
+	}
+	return frequency_idx >= ScanPlan::TRANSPONDER_SIZE_BS ? 0 : -1;
+}
+
+void push_entry(std::vector<Import::Entry>& entries, const Import::Entry& entry, int32_t line)
+{
+	if (entry.frequency_idx < 0 || entry.frequency_idx >= ScanPlan::TRANSPONDER_SIZE_BS + ScanPlan::TRANSPONDER_SIZE_CS
+		|| entry.slot >= ScanPlan::SLOT_SIZE)
+	{
+		std::ostringstream os;
+		os << "failed to import " << entry.name << " at line " << line;
+		throw std::runtime_error(os.str());
+	}
+	entries.emplace_back(entry);
+}
+
+std::vector<std::string> split(const std::string& line, char delim)
+{
+	std::vector<std::string> fields;
+	std::istringstream is(line);
+	std::string field;
+	while (std::getline(is, field, delim))
+	{
+		field = trim(field);
+		if (!field.empty())
+		{
+			fields.emplace_back(field);
+		}
+	}
+	return fields;
+}
+
+}
+
+std::vector<Import::Entry> Import::load(const std::string& format, const std::string& path)
+{
+	std::ifstream ifs(path);
+	if (!ifs)
+	{
+		throw std::runtime_error("failed to open " + path);
+	}
+	return parse(format, ifs);
+}
+
+std::vector<Import::Entry> Import::parse(const std::string& format, std::istream& is)
+{
+	if (import_.count(format))
+	{
+		return import_.at(format)(is);
+	}
+
+	throw std::runtime_error("failed to import invalid format");
+}
+
+ScanPlan Import::plan(const std::vector<Entry>& entries, int32_t ts_number_size)
+{
+	std::map<int32_t, std::set<int32_t>> slots;
+	for (const auto& entry : entries)
+	{
+		auto& s = slots[entry.frequency_idx];
+		if (entry.slot >= 0)
+		{
+			s.insert(entry.slot);
+			continue;
+		}
+		// the slot has to be searched for the TSID
+		for (auto tsnum = 0; tsnum < ts_number_size; tsnum++)
+		{
+			s.insert(tsnum);
+		}
+	}
+
+	std::vector<PlanEntry> bs;
+	std::vector<PlanEntry> cs;
+	for (const auto& [idx, s] : slots)
+	{
+		auto entry = ScanPlan::entry(idx, std::vector<int32_t>(s.begin(), s.end()));
+		(idx < ScanPlan::TRANSPONDER_SIZE_BS ? bs : cs).emplace_back(entry);
+	}
+
+	ScanPlan plan;
+	plan.set_bs(bs);
+	plan.set_cs(cs);
+	return plan;
+}
+
+nlohmann::json Import::verify(const std::vector<Entry>& entries, const nlohmann::json& json)
+{
+	std::map<int32_t, ChSet> chsets;
+	for (const auto& band : {"BS", "CS"})
+	{
+		if (!json.contains(band)) continue;
+		for (const auto& c : json.at(band).get<std::vector<ChSet>>())
+		{
+			chsets[c.frequency_idx()] = c;
+		}
+	}
+
+	auto report = nlohmann::json::array();
+	for (const auto& entry : entries)
+	{
+		auto slot = entry.slot;
+		auto tsid = 0xffff;
+		std::string status = "unverified";
+		auto it = chsets.find(entry.frequency_idx);
+		if (it != chsets.end())
+		{
+			const auto& c = it->second;
+			if (slot < 0)
+			{
+				for (size_t tsnum = 0; tsnum < c.transport_stream_id().size(); tsnum++)
+				{
+					if (c.transport_stream_id(tsnum) == entry.transport_stream_id)
+					{
+						slot = tsnum;
+					}
+				}
+				auto is_probed = false;
+				for (auto s : c.slot_status())
+				{
+					is_probed = is_probed || s == SlotStatus::found || s == SlotStatus::not_found;
+				}
+				status = slot >= 0 ? "ok" : (is_probed ? "stale" : "unverified");
+				tsid = slot >= 0 ? entry.transport_stream_id : 0xffff;
+			}
+			else
+			{
+				auto s = c.slot_status(slot);
+				tsid = c.transport_stream_id(slot);
+				if (s == SlotStatus::found || s == SlotStatus::not_found)
+				{
+					auto is_ok = tsid != 0xffff && (entry.transport_stream_id == 0xffff || entry.transport_stream_id == tsid);
+					status = is_ok ? "ok" : "stale";
+				}
+			}
+		}
+
+		report.push_back({
+			{"name", entry.name},
+			{"frequency_idx", entry.frequency_idx},
+			{"slot", slot},
+			{"expected_tsid", entry.transport_stream_id == 0xffff ? nlohmann::json() : nlohmann::json(entry.transport_stream_id)},
+			{"transport_stream_id", tsid == 0xffff ? nlohmann::json() : nlohmann::json(tsid)},
+			{"status", status},
+		});
+	}
+
+	return report;
+}
+
+std::vector<Import::Entry> Import::json(std::istream& is)
+{
+	ChSetIndex index;
+	index.build(nlohmann::json::parse(is));
+
+	std::vector<Entry> entries;
+	for (const auto& e : index.entries())
+	{
+		entries.push_back({ e.transponder + "/TS" + std::to_string(e.slot), e.frequency_idx, e.slot, e.transport_stream_id });
+	}
+	return entries;
+}
+
+std::vector<Import::Entry> Import::libdvbv5(std::istream& is)
+{
+	std::vector<Entry> entries;
+	Entry entry = { "", -1, -1, 0xffff };
+	auto is_isdbs = false;
+	auto line_number = 0;
+	auto section_line = 0;
+
+	auto flush = [&] {
+		if (entry.name.empty() || !is_isdbs) { return; }
+		if (entry.slot < 0 && entry.transport_stream_id == 0xffff)
+		{
+			entry.slot = slot_from_name(entry.name, entry.frequency_idx);
+		}
+		push_entry(entries, entry, section_line);
+	};
+
+	std::string line;
+	while (std::getline(is, line))
+	{
+		line_number++;
+		line = trim(line);
+		if (line.empty() || line.front() == '#') continue;
+
+		if (line.front() == '[' && line.back() == ']')
+		{
+			flush();
+			entry = { line.substr(1, line.size() - 2), -1, -1, 0xffff };
+			is_isdbs = false;
+			section_line = line_number;
+			continue;
+		}
+
+		auto pos = line.find('=');
+		if (pos == std::string::npos) continue;
+		auto key = trim(line.substr(0, pos));
+		auto value = trim(line.substr(pos + 1));
+		if (key == "DELIVERY_SYSTEM")
+		{
+			is_isdbs = value == "ISDBS";
+		}
+		else if (key == "FREQUENCY")
+		{
+			// the IF (dvbv5) or the RF (dvbv5lnb) frequency
+			entry.frequency_idx = ScanPlan::frequency_idx_from_khz(to_int(value));
+		}
+		else if (key == "STREAM_ID")
+		{
+			entry.transport_stream_id = to_int(value);
+			// [BS01_0] names carry the slot, [16400] names do not
+			entry.slot = slot_from_name(entry.name, entry.frequency_idx);
+		}
+	}
+	flush();
+
+	return entries;
+}
+
+std::vector<Import::Entry> Import::mirakurun(std::istream& is)
+{
+	std::vector<Entry> entries;
+	std::string name;
+	std::string type;
+	std::string channel;
+	auto is_disabled = false;
+	auto line_number = 0;
+	auto item_line = 0;
+
+	auto flush = [&] {
+		if (channel.empty() || is_disabled || (type != "BS" && type != "CS")) { return; }
+		Entry entry = { name.empty() ? channel : name, frequency_idx_from_name(channel), -1, 0xffff };
+		if (entry.frequency_idx >= 0)
+		{
+			entry.slot = slot_from_name(channel, entry.frequency_idx);
+		}
+		else
+		{
+			entry.transport_stream_id = to_int(channel);
+			entry.frequency_idx = ScanPlan::frequency_idx_from_tsid(entry.transport_stream_id);
+			entry.slot = type == "CS" ? 0 : -1;
+		}
+		push_entry(entries, entry, item_line);
+	};
+
+	std::string line;
+	while (std::getline(is, line))
+	{
+		line_number++;
+		auto pos = line.find(':');
+		if (pos == std::string::npos) continue;
+		auto key = trim(line.substr(0, pos));
+		auto value = trim(line.substr(pos + 1));
+		if (key.compare(0, 2, "- ") == 0)
+		{
+			flush();
+			name.clear();
+			type.clear();
+			channel.clear();
+			is_disabled = false;
+			item_line = line_number;
+			key = trim(key.substr(2));
+		}
+
+		if (key == "name") { name = value; }
+		else if (key == "type") { type = value; }
+		else if (key == "channel") { channel = value; }
+		else if (key == "isDisabled") { is_disabled = value == "true"; }
+	}
+	flush();
+
+	return entries;
+}
+
+std::vector<Import::Entry> Import::bondriver_pt(std::istream& is)
+{
+	std::vector<Entry> entries;
+	std::string line;
+	auto line_number = 0;
+	while (std::getline(is, line))
+	{
+		line_number++;
+		if (line.empty() || line.front() == '#' || line.front() == ';') continue;
+		auto fields = split(line, '\t');
+		if (fields.size() < 4) continue;
+		push_entry(entries, { fields.at(0), to_int(fields.at(2)), to_int(fields.at(3)), 0xffff }, line_number);
+	}
+	return entries;
+}
+
+std::vector<Import::Entry> Import::bondriver_dvb(std::istream& is)
+{
+	std::vector<Entry> entries;
+	std::string line;
+	auto line_number = 0;
+	while (std::getline(is, line))
+	{
+		line_number++;
+		if (line.empty() || line.front() == '#' || line.front() == ';') continue;
+		auto fields = split(line, '\t');
+		if (fields.size() < 4) continue;
+		auto idx = to_int(fields.at(2));
+		Entry entry = { fields.at(0), idx, slot_from_name(fields.at(0), idx), static_cast<uint16_t>(to_int(fields.at(3))) };
+		push_entry(entries, entry, line_number);
+	}
+	return entries;
+}
+
+std::vector<Import::Entry> Import::bondriver_ptx(std::istream& is)
+{
+	std::vector<Entry> entries;
+	std::string line;
+	auto line_number = 0;
+	auto is_channel = false;
+	while (std::getline(is, line))
+	{
+		line_number++;
+		line = trim(line);
+		if (line.empty() || line.front() == ';') continue;
+		if (line.front() == '[')
+		{
+			is_channel = line.size() > 9 && line.compare(line.size() - 9, 9, ".Channel]") == 0;
+			continue;
+		}
+		auto pos = line.find('=');
+		if (!is_channel || pos == std::string::npos) continue;
+		auto fields = split(line.substr(pos + 1), ',');
+		if (fields.size() < 3) continue;
+		push_entry(entries, { fields.at(0), to_int(fields.at(1)), to_int(fields.at(2)), 0xffff }, line_number);
+	}
+	return entries;
+}
+
+std::vector<Import::Entry> Import::bondriver_px4(std::istream& is)
+{
+	std::vector<Entry> entries;
+	std::string line;
+	auto line_number = 0;
+	while (std::getline(is, line))
+	{
+		line_number++;
+		if (line.empty() || line.front() == '#' || line.front() == ';') continue;
+		auto fields = split(line, '\t');
+		if (fields.size() < 5) continue;
+		auto idx = to_int(fields.at(3));
+		Entry entry = { fields.at(0), idx, slot_from_name(fields.at(0), idx), static_cast<uint16_t>(to_int(fields.at(4))) };
+		push_entry(entries, entry, line_number);
+	}
+	return entries;
+}
+
+}
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "json.hpp"
+
+#include "scan_plan.h"
+
+namespace px4tsid
+{
+
+// reads the channel files written by Convert back into (frequency_idx, slot, TSID)
+class Import
+{
+public:
+	struct Entry
+	{
+		std::string name;
+		int32_t frequency_idx;
+		int32_t slot;                 // -1 if the format has no slot
+		uint16_t transport_stream_id; // 0xffff if the format has no TSID
+	};
+
+	Import() = delete;
+	~Import() = delete;
+
+	static std::vector<Entry> load(const std::string& format, const std::string& path);
+	static std::vector<Entry> parse(const std::string& format, std::istream& is);
+	static ScanPlan plan(const std::vector<Entry>& entries, int32_t ts_number_size);
+	static nlohmann::json verify(const std::vector<Entry>& entries, const nlohmann::json& json);
+
+private:
+	static std::vector<Entry> json(std::istream& is);
+	static std::vector<Entry> libdvbv5(std::istream& is);
+	static std::vector<Entry> mirakurun(std::istream& is);
+	static std::vector<Entry> bondriver_pt(std::istream& is);
+	static std::vector<Entry> bondriver_dvb(std::istream& is);
+	static std::vector<Entry> bondriver_ptx(std::istream& is);
+	static std::vector<Entry> bondriver_px4(std::istream& is);
+
+	static const inline std::unordered_map<std::string, std::function<std::vector<Entry>(std::istream&)>> import_
+	{
+		{"json", Import::json},
+		{"dvbv5", Import::libdvbv5},
+		{"dvbv5lnb", Import::libdvbv5},
+		{"dvbv5tsid", Import::libdvbv5},
+		{"dvbv5lnbtsid", Import::libdvbv5},
+		{"mirakurun", Import::mirakurun},
+		{"mirakuruntsid", Import::mirakurun},
+		{"bondvb", Import::bondriver_dvb},
+		{"bonpt", Import::bondriver_pt},
+		{"bonptx", Import::bondriver_ptx},
+		{"bonpx4", Import::bondriver_px4},
+	};
+};
+
+}
@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "json.hpp"
+
+#include "logger.h"
+
+namespace px4tsid
+{
+
+namespace
+{
+
+const char* level_name(LogLevel level)
+{
+	switch (level)
+	{
+	case LogLevel::error: return "error";
+	case LogLevel::warn: return "warn";
+	case LogLevel::info: return "info";
+	default: return "debug";
+	}
+}
+
+void write_all(const std::string& s)
+{
+	size_t done = 0;
+	while (done < s.size())
+	{
+		auto ret = ::write(STDERR_FILENO, s.data() + done, s.size() - done);
+		if (ret <= 0) { return; }
+		done += ret;
+	}
+}
+
+}
+
+Logger& logger()
+{
+	static Logger instance;
+	return instance;
+}
+
+Logger::Logger() :
+	ring_(new Record[RING_SIZE])
+{
+	for (uint64_t i = 0; i < RING_SIZE; i++)
+	{
+		ring_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+Logger::~Logger()
+{
+	has_stop_ = true;
+	if (thread_.joinable())
+	{
+		thread_.join();
+	}
+}
+
+void Logger::log(LogLevel level, const char* fmt, ...)
+{
+	std::call_once(started_, [this] { thread_ = std::thread(&Logger::run, this); });
+
+	// bounded MPSC ring, a slot is free when its sequence equals the position
+	auto pos = head_.load(std::memory_order_relaxed);
+	Record* record;
+	while (true)
+	{
+		record = &ring_[pos % RING_SIZE];
+		auto sequence = record->sequence.load(std::memory_order_acquire);
+		auto diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+		if (diff == 0)
+		{
+			if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		else
+		{
+			pos = head_.load(std::memory_order_relaxed);
+		}
+	}
+
+	record->level = level;
+	record->time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	va_list ap;
+	va_start(ap, fmt);
+	std::vsnprintf(record->text, sizeof(record->text), fmt, ap);
+	va_end(ap);
+	record->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void Logger::flush()
+{
+	if (!thread_.joinable())
+	{
+		return;
+	}
+
+	while (tail_.load(std::memory_order_acquire) != head_.load(std::memory_order_acquire))
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void Logger::append(std::string& out, LogLevel level, int64_t time_us, const char* text) const
+{
+	if (format_.load(std::memory_order_relaxed) == Format::text)
+	{
+		out += text;
+		return;
+	}
+
+	::time_t sec = time_us / 1000000;
+	::tm tm;
+	::gmtime_r(&sec, &tm);
+	char time[40];
+	auto n = std::strftime(time, sizeof(time), "%Y-%m-%dT%H:%M:%S", &tm);
+	std::snprintf(time + n, sizeof(time) - n, ".%06dZ", static_cast<int>(time_us % 1000000));
+	out += nlohmann::json{
+		{"time", time},
+		{"level", level_name(level)},
+		{"msg", text},
+	}.dump();
+}
+
+void Logger::run()
+{
+	while (!has_stop_)
+	{
+		if (!drain())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	}
+	drain();
+}
+
+bool Logger::drain()
+{
+	std::string out;
+	auto tail = tail_.load(std::memory_order_relaxed);
+	while (true)
+	{
+		auto& record = ring_[tail % RING_SIZE];
+		if (record.sequence.load(std::memory_order_acquire) != tail + 1)
+		{
+			break;
+		}
+
+		append(out, record.level, record.time_us, record.text);
+		out += '\n';
+
+		record.sequence.store(tail + RING_SIZE, std::memory_order_release);
+		tail++;
+	}
+
+	auto dropped = dropped_.exchange(0, std::memory_order_relaxed);
+	if (dropped > 0)
+	{
+		auto now = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		append(out, LogLevel::warn, now, ("dropped " + std::to_string(dropped) + " log records").c_str());
+		out += '\n';
+	}
+
+	if (out.empty())
+	{
+		return false;
+	}
+	write_all(out);
+	tail_.store(tail, std::memory_order_release);
+	return true;
+}
+
+}
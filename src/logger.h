@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace px4tsid
+{
+
+enum class LogLevel
+{
+	error,
+	warn,
+	info,
+	debug,
+};
+
+// Records are formatted by the caller into a fixed slot of a lock-free ring
+// and written to stderr by a background thread, so logging never blocks the
+// scan on a slow stderr. A full ring drops records and counts them.
+class Logger
+{
+public:
+	enum class Format
+	{
+		text,
+		json,
+	};
+
+	Logger();
+	~Logger();
+	Logger(const Logger&) = delete;
+	Logger& operator=(const Logger&) = delete;
+
+	void set_level(LogLevel level) { level_.store(static_cast<int32_t>(level), std::memory_order_relaxed); }
+	void set_format(Format format) { format_.store(format, std::memory_order_relaxed); }
+	bool is_enabled(LogLevel level) const
+	{
+		return static_cast<int32_t>(level) <= level_.load(std::memory_order_relaxed);
+	}
+	void log(LogLevel level, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+	void flush();
+
+private:
+	struct Record
+	{
+		std::atomic<uint64_t> sequence;
+		LogLevel level;
+		int64_t time_us;
+		char text[240];
+	};
+
+#if defined(PX4TSID_LOW_MEMORY)
+	static constexpr uint64_t RING_SIZE = 64;
+#else
+	static constexpr uint64_t RING_SIZE = 1024;
+#endif
+
+	std::unique_ptr<Record[]> ring_;
+	std::atomic<uint64_t> head_{0};
+	std::atomic<uint64_t> tail_{0};
+	std::atomic<int32_t> level_{static_cast<int32_t>(LogLevel::info)};
+	std::atomic<Format> format_{Format::text};
+	std::atomic<uint64_t> dropped_{0};
+	std::atomic<bool> has_stop_{false};
+	std::once_flag started_;
+	std::thread thread_;
+
+	void run();
+	bool drain();
+	void append(std::string& out, LogLevel level, int64_t time_us, const char* text) const;
+};
+
+Logger& logger();
+
+}
+
+#define PX4TSID_LOG(level, ...) \
+	do { \
+		if (::px4tsid::logger().is_enabled(level)) { ::px4tsid::logger().log(level, __VA_ARGS__); } \
+	} while (0)
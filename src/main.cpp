@@ -1,24 +1,301 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <signal.h>
+#include <sys/resource.h>
+
 #include <cstdint>
+#include <cstring>
+#include <chrono>
 #include <exception>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
 
-#include "tsid_scan.h"
+#include "json.hpp"
+
+#include "cancel_token.h"
+#include "chset_index.h"
+#include "config.h"
 #include "convert.h"
+#include "dvb_device.h"
+#include "import.h"
+#include "logger.h"
+#include "probe.h"
+#include "query_server.h"
+#include "single_flight.h"
+#include "sweep.h"
+#include "ts_analyzer.h"
+#include "tsid_scan.h"
+
+namespace
+{
+
+px4tsid::CancelToken cancel_token;
+
+void signal_handler(int signum)
+{
+	cancel_token.cancel();
+}
+
+void set_signal_handler()
+{
+	struct ::sigaction sa;
+	std::memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = signal_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+	sigaction(SIGPIPE, &sa, nullptr);
+}
+
+nlohmann::json load_table(const std::string& path)
+{
+	std::ifstream ifs(path);
+	if (!ifs)
+	{
+		throw std::runtime_error("failed to open table " + path);
+	}
+	return nlohmann::json::parse(ifs);
+}
+
+// logs the peak RSS when main returns, after the result is written out
+class PeakRssLog
+{
+public:
+	explicit PeakRssLog(bool is_enabled) : is_enabled_(is_enabled) {}
+	~PeakRssLog()
+	{
+		struct ::rusage usage;
+		if (is_enabled_ && ::getrusage(RUSAGE_SELF, &usage) == 0)
+		{
+			PX4TSID_LOG(px4tsid::LogLevel::info, "peak RSS %ld KB", usage.ru_maxrss);
+		}
+	}
+
+private:
+	bool is_enabled_;
+};
+
+}
 
 int main(int argc, char** argv)
 {
 	try
 	{
-		px4tsid::TSIDScan scan;
-		scan.init(argc, argv);
-		scan.scan();
+		px4tsid::Config config;
+		config.parse(argc, argv);
+		px4tsid::logger().set_level(config.is_quiet() ? px4tsid::LogLevel::error : px4tsid::LogLevel::info);
+		px4tsid::logger().set_format(config.log_format() == "json" ? px4tsid::Logger::Format::json : px4tsid::Logger::Format::text);
+		PeakRssLog peak_rss(config.memory_budget_kb() > 0);
+
+		if (!config.query().empty())
+		{
+			auto response = px4tsid::QueryClient::request(config.query(), config.request());
+			std::cout << response << '\n';
+			return response.compare(0, 2, "OK") == 0 ? 0 : 1;
+		}
+
+		if (!config.analyze().empty())
+		{
+			px4tsid::TSAnalyzer analyzer;
+			analyzer.analyze(config.analyze());
+			if (config.format() == "ndjson")
+			{
+				for (const auto& change : analyzer.timeline())
+				{
+					std::cout << nlohmann::json(change).dump() << '\n';
+				}
+				return 0;
+			}
+			std::cout << analyzer.json().dump(4) << '\n';
+			return 0;
+		}
+
+		if (!config.verify().empty())
+		{
+			set_signal_handler();
+			auto entries = px4tsid::Import::load(config.verify_format(), config.verify());
+			px4tsid::TSIDScan scan;
+			scan.init(config);
+			scan.set_plan(px4tsid::Import::plan(entries, config.ts_number_size()));
+			scan.scan(px4tsid::SlotCallback(), cancel_token);
+			if (cancel_token.is_cancelled())
+			{
+				throw std::runtime_error("catch signal");
+			}
+			auto report = px4tsid::Import::verify(entries, scan.json());
+			auto is_ok = true;
+			for (const auto& r : report)
+			{
+				is_ok = is_ok && r.at("status") == "ok";
+				if (config.format() == "ndjson")
+				{
+					std::cout << r.dump() << '\n';
+				}
+			}
+			if (config.format() != "ndjson")
+			{
+				std::cout << report.dump(4) << '\n';
+			}
+			return is_ok ? 0 : 2;
+		}
+
+		if (config.is_sweep())
+		{
+			set_signal_handler();
+			px4tsid::Sweep sweep;
+			sweep.init(config);
+			sweep.sweep(cancel_token);
+			if (cancel_token.is_cancelled())
+			{
+				throw std::runtime_error("catch signal");
+			}
+			if (config.format() == "ndjson")
+			{
+				for (const auto& carrier : sweep.carriers())
+				{
+					std::cout << nlohmann::json(carrier).dump() << '\n';
+				}
+				return 0;
+			}
+			std::cout << sweep.json().dump(4) << '\n';
+			return 0;
+		}
+
+		if (config.probe() >= 0)
+		{
+			set_signal_handler();
+			auto start = std::chrono::steady_clock::now();
+			auto tsid = static_cast<uint16_t>(config.probe());
+			px4tsid::ChSetIndex index;
+			index.build(config.table().empty() ? px4tsid::Probe::load_cache() : load_table(config.table()));
+			auto expected = index.find_tsid(tsid);
+			px4tsid::TSIDScan scan;
+			scan.init(config);
+			scan.set_plan(px4tsid::Probe::plan(tsid, expected, config.ts_number_size()));
+			if (!config.handoff().empty())
+			{
+				// the DVB demux only passes PAT during a scan, nothing a recorder could use
+				if (px4tsid::DVBDevice::is_dvb_device(config.device()))
+				{
+					throw std::runtime_error("--handoff needs px4_drv DEVICE");
+				}
+				scan.set_handoff([&](const px4tsid::SlotResult& r, px4tsid::Tuner& tuner) {
+					if (r.transport_stream_id != tsid)
+					{
+						return false;
+					}
+					px4tsid::Handoff::send(config.handoff(), tuner.handoff_fd(), px4tsid::Handoff::message(r, tuner.device()));
+					return true;
+				});
+			}
+			std::optional<px4tsid::SlotResult> found;
+			scan.scan([&](const px4tsid::SlotResult& r) {
+				if (r.status == px4tsid::SlotStatus::found && r.transport_stream_id == tsid)
+				{
+					found = r;
+					cancel_token.cancel();
+				}
+			}, cancel_token);
+			if (cancel_token.is_cancelled() && !found)
+			{
+				throw std::runtime_error("catch signal");
+			}
+			auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+			auto report = px4tsid::Probe::report(tsid, expected, found ? &*found : nullptr, elapsed);
+			std::cout << (config.format() == "ndjson" ? report.dump() : report.dump(4)) << '\n';
+			switch (px4tsid::Probe::status(expected, found ? &*found : nullptr))
+			{
+			case px4tsid::Probe::Status::ok:
+				return 0;
+			case px4tsid::Probe::Status::moved:
+				return 2;
+			default:
+				return 3;
+			}
+		}
+
+		nlohmann::json table;
+		if (!config.serve().empty() && !config.table().empty())
+		{
+			table = load_table(config.table());
+		}
+		else
+		{
+			set_signal_handler();
+			px4tsid::SingleFlight flight;
+			std::optional<nlohmann::json> shared;
+			if (config.is_singleflight())
+			{
+				flight.init(config);
+				shared = flight.join(cancel_token);
+			}
+			if (shared)
+			{
+				table = std::move(*shared);
+			}
+			else
+			{
+				px4tsid::TSIDScan scan;
+				scan.init(config);
+				if (config.time_budget().count() > 0)
+				{
+					scan.set_history(px4tsid::Probe::load_cache());
+				}
+				px4tsid::SlotCallback callback;
+				if (config.format() == "ndjson" && config.serve().empty())
+				{
+					callback = [](const px4tsid::SlotResult& r) {
+						std::cout << nlohmann::json(r).dump() << std::endl;
+					};
+				}
+				scan.scan(callback, cancel_token);
+				if (cancel_token.is_cancelled())
+				{
+					throw std::runtime_error("catch signal");
+				}
+				if (config.plan().empty() && scan.is_complete())
+				{
+					px4tsid::Probe::save_cache(scan);
+				}
+				if (config.is_singleflight())
+				{
+					flight.publish(scan);
+				}
+				if (callback)
+				{
+					return 0;
+				}
+				if (config.format() == "json" && config.serve().empty())
+				{
+					scan.write_json(std::cout);
+					return 0;
+				}
+				table = scan.json();
+			}
+		}
+
+		if (!config.serve().empty())
+		{
+			px4tsid::QueryServer server;
+			server.load(table);
+			if (!config.table().empty())
+			{
+				server.set_reload([&config] { return load_table(config.table()); });
+			}
+			server.listen(config.serve());
+			server.run();
+			return 0;
+		}
 
-		std::cout << px4tsid::Convert::dump(scan.format(), scan.json());
+		std::cout << px4tsid::Convert::dump(config.format(), table);
 	}
 	catch (const std::exception& ex)
 	{
+		px4tsid::logger().flush();
 		std::cerr << ex.what() << '\n';
 		return 1;
 	}
@@ -0,0 +1,201 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "chset_index.h"
+#include "logger.h"
+#include "probe.h"
+#include "scan_plan.h"
+#include "tsid_scan.h"
+
+namespace px4tsid
+{
+
+namespace
+{
+
+nlohmann::json location(const std::string& band, const std::string& transponder, int32_t frequency_idx, int32_t slot)
+{
+	return nlohmann::json{
+		{"band", band},
+		{"transponder", transponder},
+		{"frequency_idx", frequency_idx},
+		{"slot", slot},
+	};
+}
+
+}
+
+ScanPlan Probe::plan(uint16_t tsid, const ChSetIndex::Entry* expected, int32_t ts_number_size)
+{
+	constexpr auto size = ScanPlan::TRANSPONDER_SIZE_BS + ScanPlan::TRANSPONDER_SIZE_CS;
+	std::vector<int32_t> slots;
+	for (auto tsnum = 0; tsnum < ts_number_size; tsnum++)
+	{
+		slots.push_back(tsnum);
+	}
+
+	std::vector<PlanEntry> bs;
+	std::vector<PlanEntry> cs;
+	std::set<int32_t> planned;
+	auto add = [&](int32_t idx, const std::vector<int32_t>& s) {
+		if (idx < 0 || idx >= size || !planned.insert(idx).second)
+		{
+			return;
+		}
+		auto is_bs = idx < ScanPlan::TRANSPONDER_SIZE_BS;
+		auto entry = ScanPlan::entry(idx, is_bs ? s : std::vector<int32_t>{0});
+		entry.set_timeout_ms(SLOT_TIMEOUT.count());
+		(is_bs ? bs : cs).emplace_back(entry);
+	};
+
+	// the expected slot, then the rest of its transponder while it is tuned
+	auto encoded = ScanPlan::frequency_idx_from_tsid(tsid);
+	auto nearest = encoded;
+	if (expected != nullptr)
+	{
+		std::vector<int32_t> s = { expected->slot };
+		std::copy_if(slots.begin(), slots.end(), std::back_inserter(s), [&](int32_t tsnum) { return tsnum != expected->slot; });
+		add(expected->frequency_idx, s);
+		nearest = expected->frequency_idx;
+	}
+	add(encoded, slots);
+
+	// the rest of the band nearest first, both bands when the TSID tells nothing
+	std::vector<int32_t> rest;
+	for (auto idx = 0; idx < size; idx++)
+	{
+		if (nearest == -1 || (idx < ScanPlan::TRANSPONDER_SIZE_BS) == (nearest < ScanPlan::TRANSPONDER_SIZE_BS))
+		{
+			rest.push_back(idx);
+		}
+	}
+	if (nearest != -1)
+	{
+		std::stable_sort(rest.begin(), rest.end(), [nearest](int32_t a, int32_t b) { return std::abs(a - nearest) < std::abs(b - nearest); });
+	}
+	for (auto idx : rest)
+	{
+		add(idx, slots);
+	}
+
+	ScanPlan plan;
+	plan.set_bs(bs);
+	plan.set_cs(cs);
+	return plan;
+}
+
+Probe::Status Probe::status(const ChSetIndex::Entry* expected, const SlotResult* found)
+{
+	if (found == nullptr)
+	{
+		return Status::not_found;
+	}
+	if (expected != nullptr && expected->frequency_idx == found->frequency_idx && expected->slot == found->slot)
+	{
+		return Status::ok;
+	}
+	return Status::moved;
+}
+
+nlohmann::json Probe::report(uint16_t tsid, const ChSetIndex::Entry* expected, const SlotResult* found,
+	std::chrono::milliseconds elapsed)
+{
+	return nlohmann::json{
+		{"transport_stream_id", tsid},
+		{"status", status(expected, found)},
+		{"expected", expected == nullptr ? nlohmann::json() :
+			location(expected->band, expected->transponder, expected->frequency_idx, expected->slot)},
+		{"found", found == nullptr ? nlohmann::json() :
+			location(found->band, found->transponder, found->frequency_idx, found->slot)},
+		{"elapsed_ms", elapsed.count()},
+	};
+}
+
+std::string Probe::cache_path()
+{
+	std::string dir;
+	if (auto cache = std::getenv("XDG_CACHE_HOME"); cache != nullptr && cache[0] == '/')
+	{
+		dir = cache;
+	}
+	else if (auto home = std::getenv("HOME"); home != nullptr && home[0] != '\0')
+	{
+		dir = std::string(home) + "/.cache";
+	}
+	else
+	{
+		return "";
+	}
+	return dir + "/px4tsid/tsids.json";
+}
+
+bool Probe::make_cache_dir(const std::string& path)
+{
+	for (auto pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1))
+	{
+		if (::mkdir(path.substr(0, pos).c_str(), 0755) == -1 && errno != EEXIST)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+nlohmann::json Probe::load_cache()
+{
+	auto path = cache_path();
+	std::ifstream ifs(path);
+	if (path.empty() || !ifs)
+	{
+		return nlohmann::json::object();
+	}
+	return nlohmann::json::parse(ifs, nullptr, false);
+}
+
+void Probe::save_cache(const TSIDScan& scan)
+{
+	auto path = cache_path();
+	if (path.empty())
+	{
+		return;
+	}
+
+	// best effort, a read-only home must not fail the scan
+	if (!make_cache_dir(path))
+	{
+		PX4TSID_LOG(LogLevel::debug, "failed to create cache %s", path.c_str());
+		return;
+	}
+	auto tmp = path + ".tmp";
+	{
+		std::ofstream ofs(tmp);
+		scan.write_json(ofs);
+		ofs << '\n';
+		if (!ofs)
+		{
+			PX4TSID_LOG(LogLevel::debug, "failed to write cache %s", tmp.c_str());
+			return;
+		}
+	}
+	if (std::rename(tmp.c_str(), path.c_str()) != 0)
+	{
+		PX4TSID_LOG(LogLevel::debug, "failed to write cache %s", path.c_str());
+	}
+}
+
+}
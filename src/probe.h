@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <string>
+
+#include "json.hpp"
+
+#include "chset_index.h"
+#include "scan_plan.h"
+#include "tsid_scan.h"
+
+namespace px4tsid
+{
+
+// Checks a single TSID before a recording. The slot the table has it on is
+// tried first, then the other slots of that transponder, the transponder
+// encoded in the TSID and the rest of the band, nearest first.
+class Probe
+{
+public:
+	enum class Status
+	{
+		ok,
+		moved,
+		not_found,
+	};
+
+	static constexpr std::chrono::milliseconds SLOT_TIMEOUT{1000};
+
+	static ScanPlan plan(uint16_t tsid, const ChSetIndex::Entry* expected, int32_t ts_number_size);
+	static Status status(const ChSetIndex::Entry* expected, const SlotResult* found);
+	static nlohmann::json report(uint16_t tsid, const ChSetIndex::Entry* expected, const SlotResult* found,
+		std::chrono::milliseconds elapsed);
+
+	// table of the last full scan, so that --probe works without --table
+	static std::string cache_path();
+	// creates the directories above path
+	static bool make_cache_dir(const std::string& path);
+	static nlohmann::json load_cache();
+	static void save_cache(const TSIDScan& scan);
+};
+
+NLOHMANN_JSON_SERIALIZE_ENUM(Probe::Status, {
+	{Probe::Status::ok, "ok"},
+	{Probe::Status::moved, "moved"},
+	{Probe::Status::not_found, "not_found"},
+})
+
+}
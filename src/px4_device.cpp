@@ -1,16 +1,24 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
+#include <cerrno>
 #include <cstdint>
+#include <cstring>
+#include <chrono>
 #include <stdexcept>
 #include <string>
 #include <sstream>
 
+#include "deadline_timer.h"
 #include "ptx_ioctl.h"
 #include "px4_device.h"
+#include "scan_plan.h"
+#include "trace.h"
 
 namespace px4tsid
 {
@@ -22,16 +30,35 @@ void PX4Device::open_tuner(const std::string& device)
 		close_tuner();
 	}
 
-	fd_ = ::open(device.c_str(), O_RDONLY);
+	PX4TSID_TRACE(open__start, device.c_str());
+	fd_ = call_with_timeout(time_left("open"), "open", [&] {
+		return ::open(device.c_str(), O_RDONLY | O_NONBLOCK);
+	});
 	if (fd_ == -1)
 	{
+		auto is_busy = errno == EBUSY;
 		device_.clear();
 		std::ostringstream os;
 		os << "failed to open tuner " << device;
+		if (is_busy)
+		{
+			throw BusyError(os.str());
+		}
 		throw std::runtime_error(os.str());
 	}
 
 	device_ = device;
+	PX4TSID_TRACE(open__done, device.c_str(), fd_);
+}
+
+bool PX4Device::lock_tuner()
+{
+	if (fd_ == -1)
+	{
+		throw std::runtime_error("no open device");
+	}
+
+	return ::flock(fd_, LOCK_EX | LOCK_NB) == 0;
 }
 
 void PX4Device::close_tuner()
@@ -42,12 +69,32 @@ void PX4Device::close_tuner()
 
 	if (lnb_power_state_)
 	{
-		::ioctl(fd_, PTX_DISABLE_LNB_POWER);
+		try
+		{
+			call_with_timeout(timeout_, "ioctl(PTX_DISABLE_LNB_POWER)", [&] {
+				return ::ioctl(fd_, PTX_DISABLE_LNB_POWER);
+			});
+		}
+		catch (const TimeoutError&)
+		{
+		}
 		lnb_power_state_ = false;
 	}
 
 	::close(fd_);
 	fd_ = -1;
+	system_mode_state_ = false;
+}
+
+void PX4Device::detach()
+{
+	if (fd_ == -1) { return; }
+
+	::close(fd_);
+	fd_ = -1;
+	has_streaimng_ = false;
+	lnb_power_state_ = false;
+	system_mode_state_ = false;
 }
 
 void PX4Device::set_channel_s(int32_t freq_num, int32_t slot_num)
@@ -57,26 +104,127 @@ void PX4Device::set_channel_s(int32_t freq_num, int32_t slot_num)
 		throw std::runtime_error("no open device");
 	}
 
-	if (::ioctl(fd_, PTX_SET_SYSTEM_MODE, ptx_system_type::PTX_ISDB_S_SYSTEM) == -1)
+	PX4TSID_TRACE(tune__start, freq_num, slot_num);
+	power_on();
+
+	auto ret = set_channel(freq_num, slot_num);
+	if (ret == -1 && has_streaimng_)
+	{
+		// the driver refused to retune a running stream, restart it the old way
+		stop_streaming();
+		ret = set_channel(freq_num, slot_num);
+	}
+	if (ret == -1)
+	{
+		system_mode_state_ = false;
+		std::ostringstream os;
+		os << "failed to ioctl(PTX_SET_CHANNEL) freq: " << freq_num << " slot: " << slot_num;
+		throw std::runtime_error(os.str());
+	}
+	if (has_streaimng_)
+	{
+		// the stream kept running, discard what was queued before the retune
+		drain();
+	}
+	PX4TSID_TRACE(tune__done, freq_num, slot_num);
+}
+
+void PX4Device::set_frequency_s(uint32_t frequency_khz, int32_t slot_num)
+{
+	if (fd_ == -1)
+	{
+		throw std::runtime_error("no open device");
+	}
+
+	PX4TSID_TRACE(tune_khz__start, frequency_khz, slot_num);
+	power_on();
+
+	auto ret = set_params(frequency_khz - ScanPlan::LNB_LOCAL_KHZ, slot_num);
+	if (ret == -1 && has_streaimng_)
+	{
+		stop_streaming();
+		ret = set_params(frequency_khz - ScanPlan::LNB_LOCAL_KHZ, slot_num);
+	}
+	if (ret == -1)
+	{
+		system_mode_state_ = false;
+		std::ostringstream os;
+		os << "failed to ioctl(PTXT_TUNE) freq: " << frequency_khz << "kHz slot: " << slot_num;
+		throw std::runtime_error(os.str());
+	}
+	if (has_streaimng_)
+	{
+		drain();
+	}
+	PX4TSID_TRACE(tune_khz__done, frequency_khz, slot_num);
+}
+
+void PX4Device::power_on()
+{
+	if (!system_mode_state_)
 	{
-		throw std::runtime_error("failed to ioctl(PTX_SET_SYSTEM_MODE)");
+		auto ret = call_with_timeout(time_left("ioctl(PTX_SET_SYSTEM_MODE)"), "ioctl(PTX_SET_SYSTEM_MODE)", [&] {
+			return ::ioctl(fd_, PTX_SET_SYSTEM_MODE, ptx_system_type::PTX_ISDB_S_SYSTEM);
+		});
+		if (ret == -1)
+		{
+			throw std::runtime_error("failed to ioctl(PTX_SET_SYSTEM_MODE)");
+		}
+		system_mode_state_ = true;
 	}
 
 	if (lnb_power_ && !lnb_power_state_)
 	{
-		if (::ioctl(fd_, PTX_ENABLE_LNB_POWER, 2) == -1)
+		auto ret = call_with_timeout(time_left("ioctl(PTX_ENABLE_LNB_POWER)"), "ioctl(PTX_ENABLE_LNB_POWER)", [&] {
+			return ::ioctl(fd_, PTX_ENABLE_LNB_POWER, 2);
+		});
+		if (ret == -1)
 		{
 			throw std::runtime_error("failed to ioctl(PTX_ENABLE_LNB_POWER)");
 		}
 		lnb_power_state_ = true;
 	}
+}
 
+int PX4Device::set_channel(int32_t freq_num, int32_t slot_num)
+{
 	::ptx_freq freq = { freq_num, slot_num };
-	if (::ioctl(fd_, PTX_SET_CHANNEL, &freq) == -1)
+	return call_with_timeout(time_left("ioctl(PTX_SET_CHANNEL)"), "ioctl(PTX_SET_CHANNEL)", [&] {
+		return ::ioctl(fd_, PTX_SET_CHANNEL, &freq);
+	});
+}
+
+// the extended ioctls take the IF frequency, slot_num < 8 is the relative TS number as with PTX_SET_CHANNEL
+int PX4Device::set_params(uint32_t frequency_if_khz, int32_t slot_num)
+{
+	::ptxt_additional_param prop = { PTXT_STREAM_ID_PARAM, static_cast<__u32>(slot_num) };
+	::ptxt_params params = { PTX_ISDB_S_SYSTEM, frequency_if_khz, 1, &prop };
+	auto ret = call_with_timeout(time_left("ioctl(PTXT_SET_PARAMS)"), "ioctl(PTXT_SET_PARAMS)", [&] {
+		return ::ioctl(fd_, PTXT_SET_PARAMS, &params);
+	});
+	if (ret == -1)
 	{
-		std::ostringstream os;
-		os << "failed to ioctl(PTX_SET_CHANNEL) freq: " << freq_num << " slot: " << slot_num;
-		throw std::runtime_error(os.str());
+		return ret;
+	}
+	return call_with_timeout(time_left("ioctl(PTXT_TUNE)"), "ioctl(PTXT_TUNE)", [&] {
+		return ::ioctl(fd_, PTXT_TUNE);
+	});
+}
+
+void PX4Device::drain()
+{
+	// the retuned stream never runs dry, stop at an empty buffer or DRAIN_LIMIT, whichever comes first
+	uint8_t buf[188 * 16];
+	for (size_t size_drained = 0; size_drained < DRAIN_LIMIT; )
+	{
+		auto size_read = call_with_timeout(time_left("read"), "read", [&] {
+			return ::read(fd_, buf, sizeof(buf));
+		});
+		if (size_read <= 0)
+		{
+			break;
+		}
+		size_drained += size_read;
 	}
 }
 
@@ -89,11 +237,15 @@ void PX4Device::start_streaming()
 
 	if (!has_streaimng_)
 	{
-		if (::ioctl(fd_, PTX_START_STREAMING) == -1)
+		auto ret = call_with_timeout(time_left("ioctl(PTX_START_STREAMING)"), "ioctl(PTX_START_STREAMING)", [&] {
+			return ::ioctl(fd_, PTX_START_STREAMING);
+		});
+		if (ret == -1)
 		{
 			throw std::runtime_error("failed to ioctl(PTX_START_STREAMING)");
 		}
 		has_streaimng_ = true;
+		PX4TSID_TRACE(stream__start);
 	}
 }
 
@@ -106,8 +258,18 @@ void PX4Device::stop_streaming()
 
 	if (has_streaimng_)
 	{
-		::ioctl(fd_, PTX_STOP_STREAMING);
+		// always gets the full timeout so that an expired slot deadline does not skip the cleanup
+		try
+		{
+			call_with_timeout(timeout_, "ioctl(PTX_STOP_STREAMING)", [&] {
+				return ::ioctl(fd_, PTX_STOP_STREAMING);
+			});
+		}
+		catch (const TimeoutError&)
+		{
+		}
 		has_streaimng_ = false;
+		PX4TSID_TRACE(stream__stop);
 	}
 }
 
@@ -120,10 +282,33 @@ ssize_t PX4Device::read_stream(uint8_t* buf, size_t size)
 
 	if (has_streaimng_)
 	{
-		return ::read(fd_, buf, size);
+		auto timeout = time_left("read");
+		PX4TSID_TRACE(read__start, size);
+		::pollfd pfd = { fd_, POLLIN, 0 };
+		auto ret = ::poll(&pfd, 1, timeout.count());
+		if (ret == 0)
+		{
+			PX4TSID_TRACE(read__timeout);
+			throw TimeoutError("read timed out");
+		}
+		if (ret == -1)
+		{
+			PX4TSID_TRACE(read__done, 0L);
+			return 0;
+		}
+
+		auto size_read = call_with_timeout(time_left("read"), "read", [&] {
+			return ::read(fd_, buf, size);
+		});
+		if (size_read == -1 && errno == EAGAIN)
+		{
+			size_read = 0;
+		}
+		PX4TSID_TRACE(read__done, static_cast<long>(size_read));
+		return size_read;
 	}
 
 	return -ENODATA;
 }
 
-}
\ No newline at end of file
+}
@@ -6,31 +6,48 @@
 #include <string>
 
 #include "ptx_ioctl.h"
+#include "tuner.h"
 
 namespace px4tsid
 {
 
-class PX4Device
+class PX4Device : public Tuner
 {
 public:
 	PX4Device() = default;
-	~PX4Device() { close_tuner(); }
-
-	void set_lnb_power(bool is_enable) { lnb_power_ = is_enable; }
-	bool has_straming() const { return has_streaimng_; }
-	void open_tuner(const std::string& device);
-	void close_tuner();
-	void set_channel_s(int32_t freq_num, int32_t slot_num);
-	void start_streaming();
-	void stop_streaming();
-	ssize_t read_stream(uint8_t* buf, size_t size);
+	~PX4Device() override { PX4Device::close_tuner(); }
+
+	void set_lnb_power(bool is_enable) override { lnb_power_ = is_enable; }
+	bool has_straming() const override { return has_streaimng_; }
+	const std::string& device() const override { return device_; }
+	bool is_open() const override { return fd_ != -1; }
+	void open_tuner(const std::string& device) override;
+	bool lock_tuner() override;
+	void close_tuner() override;
+	void set_channel_s(int32_t freq_num, int32_t slot_num) override;
+	void set_frequency_s(uint32_t frequency_khz, int32_t slot_num) override;
+	void start_streaming() override;
+	void stop_streaming() override;
+	ssize_t read_stream(uint8_t* buf, size_t size) override;
+	int32_t poll_fd() override { return has_streaimng_ ? fd_ : -1; }
+	int32_t handoff_fd() const override { return has_streaimng_ ? fd_ : -1; }
+	void detach() override;
 
 private:
+	// bounds the drain of a stream that never runs dry, about 0.2s of a transponder
+	static constexpr size_t DRAIN_LIMIT = 188 * 8192;
+
 	std::string device_;
 	int32_t fd_ = -1;
 	bool lnb_power_ = false;
 	bool lnb_power_state_ = false;
 	bool has_streaimng_ = false;
+	bool system_mode_state_ = false;
+
+	void power_on();
+	int set_channel(int32_t freq_num, int32_t slot_num);
+	int set_params(uint32_t frequency_if_khz, int32_t slot_num);
+	void drain();
 };
 
-}
\ No newline at end of file
+}
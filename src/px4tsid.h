@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// public API of libpx4tsid
+
+#pragma once
+
+#include "cancel_token.h"
+#include "chset.h"
+#include "chset_index.h"
+#include "config.h"
+#include "convert.h"
+#include "dvb_device.h"
+#include "import.h"
+#include "logger.h"
+#include "probe.h"
+#include "px4_device.h"
+#include "scan_plan.h"
+#include "scheduler.h"
+#include "single_flight.h"
+#include "task.h"
+#include "timing_profile.h"
+#include "ts_analyzer.h"
+#include "ts_parser.h"
+#include "tsid_scan.h"
+#include "tuner.h"
+#include "tuner_pool.h"
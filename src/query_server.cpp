@@ -0,0 +1,354 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <csignal>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "chset_index.h"
+#include "logger.h"
+#include "query_server.h"
+#include "tsid_scan.h"
+
+namespace px4tsid
+{
+
+namespace
+{
+
+::sockaddr_un socket_address(const std::string& path)
+{
+	::sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+	{
+		throw std::runtime_error("too long socket path " + path);
+	}
+	std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+	return addr;
+}
+
+}
+
+volatile std::sig_atomic_t QueryServer::has_stop_ = 0;
+volatile std::sig_atomic_t QueryServer::has_reload_ = 0;
+
+QueryServer::~QueryServer()
+{
+	if (fd_ != -1)
+	{
+		::close(fd_);
+		::unlink(path_.c_str());
+	}
+}
+
+void QueryServer::signal_handler(int signum)
+{
+	if (signum == SIGHUP)
+	{
+		QueryServer::has_reload_ = 1;
+	}
+	else
+	{
+		QueryServer::has_stop_ = 1;
+	}
+}
+
+void QueryServer::listen(const std::string& path)
+{
+	auto addr = socket_address(path);
+	fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd_ == -1)
+	{
+		throw std::runtime_error("failed to create socket");
+	}
+
+	::unlink(path.c_str());
+	if (::bind(fd_, reinterpret_cast<::sockaddr*>(&addr), sizeof(addr)) == -1 || ::listen(fd_, 16) == -1)
+	{
+		::close(fd_);
+		fd_ = -1;
+		throw std::runtime_error("failed to listen " + path);
+	}
+	path_ = path;
+
+	struct ::sigaction sa;
+	std::memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = QueryServer::signal_handler;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+	sigaction(SIGHUP, &sa, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+}
+
+void QueryServer::run()
+{
+	std::vector<::pollfd> pfds = { { fd_, POLLIN, 0 } };
+	std::vector<std::string> bufs(1);
+
+	// the signals are delivered only inside ppoll(), so none slips in between the flag checks and the wait
+	::sigset_t blocked;
+	::sigset_t unblocked;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGTERM);
+	sigaddset(&blocked, SIGHUP);
+	::pthread_sigmask(SIG_BLOCK, &blocked, &unblocked);
+
+	while (!QueryServer::has_stop_)
+	{
+		if (QueryServer::has_reload_)
+		{
+			QueryServer::has_reload_ = 0;
+			if (reload_)
+			{
+				try
+				{
+					load(reload_());
+					PX4TSID_LOG(LogLevel::info, "reloaded %zu entries", index_.size());
+				}
+				catch (const std::exception& e)
+				{
+					PX4TSID_LOG(LogLevel::error, "failed to reload : %s", e.what());
+				}
+			}
+		}
+
+		if (::ppoll(pfds.data(), pfds.size(), nullptr, &unblocked) == -1)
+		{
+			continue;
+		}
+
+		if (pfds.at(0).revents & POLLIN)
+		{
+			auto fd = ::accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (fd != -1)
+			{
+				pfds.push_back({ fd, POLLIN, 0 });
+				bufs.emplace_back();
+			}
+		}
+
+		for (size_t i = 1; i < pfds.size(); i++)
+		{
+			auto& pfd = pfds.at(i);
+			if (!(pfd.revents & (POLLIN | POLLHUP | POLLERR)))
+			{
+				continue;
+			}
+
+			char buf[512];
+			auto size = ::read(pfd.fd, buf, sizeof(buf));
+			if (size == -1 && errno == EAGAIN)
+			{
+				continue;
+			}
+			if (size <= 0)
+			{
+				::close(pfd.fd);
+				pfd.fd = -1;
+				continue;
+			}
+
+			auto& line = bufs.at(i);
+			line.append(buf, size);
+			std::string response;
+			std::string::size_type pos;
+			while ((pos = line.find('\n')) != std::string::npos)
+			{
+				response += answer(line.substr(0, pos)) + '\n';
+				line.erase(0, pos + 1);
+			}
+			if (line.size() > sizeof(buf))
+			{
+				response += "NG too long request\n";
+				line.clear();
+			}
+			if (!response.empty() && ::send(pfd.fd, response.data(), response.size(), MSG_NOSIGNAL) == -1)
+			{
+				::close(pfd.fd);
+				pfd.fd = -1;
+			}
+		}
+
+		for (size_t i = pfds.size() - 1; i > 0; i--)
+		{
+			if (pfds.at(i).fd == -1)
+			{
+				pfds.erase(pfds.begin() + i);
+				bufs.erase(bufs.begin() + i);
+			}
+		}
+	}
+
+	for (size_t i = 1; i < pfds.size(); i++)
+	{
+		::close(pfds.at(i).fd);
+	}
+	::pthread_sigmask(SIG_SETMASK, &unblocked, nullptr);
+}
+
+std::string QueryServer::answer(const std::string& request) const
+{
+	std::istringstream is(request);
+	std::string command;
+	is >> command;
+
+	const ChSetIndex::Entry* entry = nullptr;
+	if (command == "TSID")
+	{
+		uint32_t tsid;
+		if (!(is >> tsid) || tsid > 0xffff)
+		{
+			return "NG invalid request";
+		}
+		entry = index_.find_tsid(tsid);
+	}
+	else if (command == "SLOT")
+	{
+		int32_t frequency_idx;
+		int32_t slot;
+		if (!(is >> frequency_idx >> slot))
+		{
+			return "NG invalid request";
+		}
+		entry = index_.find_slot(frequency_idx, slot);
+	}
+	else
+	{
+		return "NG unknown command";
+	}
+
+	if (entry == nullptr)
+	{
+		return "NG not found";
+	}
+
+	std::ostringstream os;
+	os << "OK " << entry->transport_stream_id
+		<< ' ' << entry->band
+		<< ' ' << entry->transponder
+		<< ' ' << entry->number
+		<< ' ' << entry->frequency_idx
+		<< ' ' << entry->slot
+		<< ' ' << entry->frequency_khz;
+	return os.str();
+}
+
+std::string QueryClient::request(const std::string& path, const std::string& request)
+{
+	auto addr = socket_address(path);
+	auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+	{
+		throw std::runtime_error("failed to create socket");
+	}
+
+	if (::connect(fd, reinterpret_cast<::sockaddr*>(&addr), sizeof(addr)) == -1)
+	{
+		::close(fd);
+		throw std::runtime_error("failed to connect " + path);
+	}
+
+	auto line = request + '\n';
+	if (::send(fd, line.data(), line.size(), MSG_NOSIGNAL) == -1)
+	{
+		::close(fd);
+		throw std::runtime_error("failed to send request");
+	}
+
+	std::string response;
+	char buf[512];
+	while (response.find('\n') == std::string::npos)
+	{
+		auto size = ::read(fd, buf, sizeof(buf));
+		if (size <= 0) { break; }
+		response.append(buf, size);
+	}
+	::close(fd);
+
+	auto pos = response.find('\n');
+	if (pos == std::string::npos)
+	{
+		throw std::runtime_error("no response");
+	}
+
+	return response.substr(0, pos);
+}
+
+std::string Handoff::message(const SlotResult& result, const std::string& device)
+{
+	std::ostringstream os;
+	os << "TUNED " << result.transport_stream_id
+		<< ' ' << result.band
+		<< ' ' << result.transponder
+		<< ' ' << result.number
+		<< ' ' << result.frequency_idx
+		<< ' ' << result.slot
+		<< ' ' << result.frequency_khz
+		<< ' ' << device;
+	return os.str();
+}
+
+void Handoff::send(const std::string& path, int32_t fd, const std::string& message)
+{
+	if (fd == -1)
+	{
+		throw std::runtime_error("no streaming tuner to hand off");
+	}
+
+	auto addr = socket_address(path);
+	auto sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock == -1)
+	{
+		throw std::runtime_error("failed to create socket");
+	}
+
+	if (::connect(sock, reinterpret_cast<::sockaddr*>(&addr), sizeof(addr)) == -1)
+	{
+		::close(sock);
+		throw std::runtime_error("failed to connect " + path);
+	}
+
+	auto line = message + '\n';
+	::iovec iov = { line.data(), line.size() };
+	alignas(::cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+	std::memset(control, 0, sizeof(control));
+	::msghdr msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	auto cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	// the fd stays referenced by the message even if px4tsid exits before it is received
+	auto size = ::sendmsg(sock, &msg, MSG_NOSIGNAL);
+	::close(sock);
+	if (size != static_cast<ssize_t>(line.size()))
+	{
+		throw std::runtime_error("failed to hand off to " + path);
+	}
+}
+
+}
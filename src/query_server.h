@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <csignal>
+#include <functional>
+#include <string>
+
+#include "json.hpp"
+
+#include "chset_index.h"
+#include "tsid_scan.h"
+
+namespace px4tsid
+{
+
+// Line based protocol over a unix domain socket.
+//   TSID <tsid>                 -> OK <tsid> <band> <transponder> <number> <frequency_idx> <slot> <frequency_khz>
+//   SLOT <frequency_idx> <slot> -> OK <tsid> <band> <transponder> <number> <frequency_idx> <slot> <frequency_khz>
+//   otherwise                   -> NG <message>
+class QueryServer
+{
+public:
+	QueryServer() = default;
+	~QueryServer();
+
+	static void signal_handler(int signum);
+	void set_reload(std::function<nlohmann::json()> reload) { reload_ = reload; }
+	void load(const nlohmann::json& json) { index_.build(json); }
+	void listen(const std::string& path);
+	void run();
+	std::string answer(const std::string& request) const;
+
+private:
+	static volatile std::sig_atomic_t has_stop_;
+	static volatile std::sig_atomic_t has_reload_;
+	std::string path_;
+	int32_t fd_ = -1;
+	ChSetIndex index_;
+	std::function<nlohmann::json()> reload_;
+};
+
+class QueryClient
+{
+public:
+	QueryClient() = delete;
+	~QueryClient() = delete;
+
+	static std::string request(const std::string& path, const std::string& request);
+};
+
+// Passes a streaming tuner to a recorder listening on a unix domain socket.
+// One line is sent with the tuner fd attached as SCM_RIGHTS:
+//   TUNED <tsid> <band> <transponder> <number> <frequency_idx> <slot> <frequency_khz> <device>
+// The fd is non-blocking and keeps the flock, the LNB power and the stream.
+class Handoff
+{
+public:
+	Handoff() = delete;
+	~Handoff() = delete;
+
+	static std::string message(const SlotResult& result, const std::string& device);
+	static void send(const std::string& path, int32_t fd, const std::string& message);
+};
+
+}
@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "scan_plan.h"
+
+namespace px4tsid
+{
+
+void to_json(nlohmann::json& j, const PlanEntry& p)
+{
+	j = nlohmann::json{
+		{"transponder", p.transponder()},
+		{"number", p.number()},
+		{"frequency_idx", p.frequency_idx()},
+		{"frequency_khz", p.frequency_khz()},
+		{"slots", p.slots()},
+		{"retry_count", p.retry_count()},
+		{"timeout_ms", p.timeout_ms()},
+	};
+}
+
+void from_json(const nlohmann::json& j, PlanEntry& p)
+{
+	// the tuner is set by frequency_idx, the rest only has to agree with it
+	p = ScanPlan::entry(j.at("frequency_idx"), j.value("slots", std::vector<int32_t>{0}));
+	p.set_transponder(j.value("transponder", p.transponder()));
+	p.set_number(j.value("number", p.number()));
+	p.set_frequency_khz(j.value("frequency_khz", p.frequency_khz()));
+	p.set_retry_count(j.value("retry_count", 0));
+	p.set_timeout_ms(j.value("timeout_ms", 0));
+}
+
+void ScanPlan::set_default(int32_t ts_number_size)
+{
+	bs_.clear();
+	cs_.clear();
+
+	std::vector<int32_t> slots;
+	for (auto tsnum = 0; tsnum < ts_number_size; tsnum++)
+	{
+		slots.emplace_back(tsnum);
+	}
+
+	for (auto idx = 0; idx < TRANSPONDER_SIZE_BS; idx++)
+	{
+		PlanEntry entry;
+		auto tpnum = idx * 2 + 1;
+		entry.set_transponder("BS" + std::to_string(tpnum));
+		entry.set_number(tpnum);
+		entry.set_frequency_idx(idx);
+		entry.set_frequency_khz(frequency_khz(idx));
+		entry.set_slots(slots);
+		bs_.emplace_back(entry);
+	}
+
+	for (auto idx = 0; idx < TRANSPONDER_SIZE_CS; idx++)
+	{
+		PlanEntry entry;
+		auto tpnum = (idx + 1) * 2;
+		auto fqidx = idx + TRANSPONDER_SIZE_BS;
+		entry.set_transponder("ND" + std::to_string(tpnum));
+		entry.set_number(tpnum);
+		entry.set_frequency_idx(fqidx);
+		entry.set_frequency_khz(frequency_khz(fqidx));
+		entry.set_slots({0});
+		cs_.emplace_back(entry);
+	}
+}
+
+void ScanPlan::load(const std::string& path)
+{
+	std::ifstream ifs(path);
+	if (!ifs)
+	{
+		std::ostringstream os;
+		os << "failed to open plan " << path;
+		throw std::runtime_error(os.str());
+	}
+
+	try
+	{
+		auto j = nlohmann::json::parse(ifs);
+		bs_ = j.value("BS", std::vector<PlanEntry>{});
+		cs_ = j.value("CS", std::vector<PlanEntry>{});
+	}
+	catch (const nlohmann::json::exception& e)
+	{
+		std::ostringstream os;
+		os << "failed to parse plan " << path << " : " << e.what();
+		throw std::runtime_error(os.str());
+	}
+
+	validate(bs_, true);
+	validate(cs_, false);
+}
+
+PlanEntry ScanPlan::entry(int32_t frequency_idx, const std::vector<int32_t>& slots)
+{
+	PlanEntry entry;
+	auto is_bs = frequency_idx < TRANSPONDER_SIZE_BS;
+	auto number = is_bs ? frequency_idx * 2 + 1 : (frequency_idx - TRANSPONDER_SIZE_BS + 1) * 2;
+	entry.set_transponder((is_bs ? "BS" : "ND") + std::to_string(number));
+	entry.set_number(number);
+	entry.set_frequency_idx(frequency_idx);
+	entry.set_frequency_khz(frequency_khz(frequency_idx));
+	entry.set_slots(slots);
+	return entry;
+}
+
+// network_id in the upper bits, transponder number in bits 4-8
+int32_t ScanPlan::frequency_idx_from_tsid(uint16_t tsid)
+{
+	auto number = (tsid >> 4) & 0x1f;
+	switch (tsid >> 12)
+	{
+	case 0x4:
+		return (number - 1) / 2;
+	case 0x6:
+	case 0x7:
+		return TRANSPONDER_SIZE_BS + number / 2 - 1;
+	default:
+		return -1;
+	}
+}
+
+int32_t ScanPlan::frequency_idx_from_khz(uint32_t khz)
+{
+	if (khz < LNB_LOCAL_KHZ)
+	{
+		khz += LNB_LOCAL_KHZ;
+	}
+	for (auto idx = 0; idx < TRANSPONDER_SIZE_BS + TRANSPONDER_SIZE_CS; idx++)
+	{
+		if (std::abs(static_cast<int32_t>(frequency_khz(idx) - khz)) <= 2000)
+		{
+			return idx;
+		}
+	}
+	return -1;
+}
+
+uint32_t ScanPlan::frequency_khz(int32_t frequency_idx)
+{
+	if (frequency_idx < TRANSPONDER_SIZE_BS)
+	{
+		return 11727480 + 38360 * frequency_idx;
+	}
+
+	return 12291000 + 40000 * (frequency_idx - TRANSPONDER_SIZE_BS);
+}
+
+void ScanPlan::validate(const std::vector<PlanEntry>& entries, bool is_bs) const
+{
+	std::vector<int32_t> seen;
+	for (const auto& entry : entries)
+	{
+		auto idx = entry.frequency_idx();
+		auto is_in_band = is_bs ? idx >= 0 && idx < TRANSPONDER_SIZE_BS
+			: idx >= TRANSPONDER_SIZE_BS && idx < TRANSPONDER_SIZE_BS + TRANSPONDER_SIZE_CS;
+		if (!is_in_band)
+		{
+			std::ostringstream os;
+			os << "invalid plan frequency_idx " << idx << " for " << (is_bs ? "BS" : "CS") << " (" << entry.transponder() << ")";
+			throw std::runtime_error(os.str());
+		}
+
+		auto expected = ScanPlan::entry(idx, entry.slots());
+		if (entry.transponder() != expected.transponder() || entry.number() != expected.number()
+			|| entry.frequency_khz() != expected.frequency_khz())
+		{
+			std::ostringstream os;
+			os << "plan entry " << entry.transponder() << " " << entry.number() << " " << entry.frequency_khz()
+				<< "kHz does not match frequency_idx " << idx << " (" << expected.transponder() << " "
+				<< expected.number() << " " << expected.frequency_khz() << "kHz)";
+			throw std::runtime_error(os.str());
+		}
+
+		if (std::find(seen.begin(), seen.end(), idx) != seen.end())
+		{
+			std::ostringstream os;
+			os << "duplicate plan frequency_idx " << idx << " (" << entry.transponder() << ")";
+			throw std::runtime_error(os.str());
+		}
+		seen.emplace_back(idx);
+
+		for (size_t i = 0; i < entry.slots().size(); i++)
+		{
+			auto slot = entry.slots()[i];
+			if (slot < 0 || slot >= SLOT_SIZE)
+			{
+				std::ostringstream os;
+				os << "invalid plan slot " << slot << " (" << entry.transponder() << ")";
+				throw std::runtime_error(os.str());
+			}
+			if (std::find(entry.slots().begin(), entry.slots().begin() + i, slot) != entry.slots().begin() + i)
+			{
+				std::ostringstream os;
+				os << "duplicate plan slot " << slot << " (" << entry.transponder() << ")";
+				throw std::runtime_error(os.str());
+			}
+		}
+	}
+}
+
+}
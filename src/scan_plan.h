@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+namespace px4tsid
+{
+
+class PlanEntry
+{
+public:
+	PlanEntry() = default;
+	~PlanEntry() = default;
+
+	const std::string& transponder() const { return transponder_; }
+	int32_t number() const { return number_; }
+	int32_t frequency_idx() const { return frequency_idx_; }
+	uint32_t frequency_khz() const { return frequency_khz_; }
+	const std::vector<int32_t>& slots() const { return slots_; }
+	int32_t retry_count() const { return retry_count_; }
+	int32_t timeout_ms() const { return timeout_ms_; }
+
+	void set_transponder(const std::string& transponder) { transponder_ = transponder; }
+	void set_number(int32_t number) { number_ = number; }
+	void set_frequency_idx(int32_t idx) { frequency_idx_ = idx; }
+	void set_frequency_khz(uint32_t freq) { frequency_khz_ = freq; }
+	void set_slots(const std::vector<int32_t>& slots) { slots_ = slots; }
+	void set_retry_count(int32_t count) { retry_count_ = count; }
+	void set_timeout_ms(int32_t timeout) { timeout_ms_ = timeout; }
+
+private:
+	std::string transponder_;
+	int32_t number_ = 0;
+	int32_t frequency_idx_ = 0;
+	uint32_t frequency_khz_ = 0;
+	std::vector<int32_t> slots_;
+	int32_t retry_count_ = 0;	// 0: use --retry-times
+	int32_t timeout_ms_ = 0;	// 0: use --slot-timeout
+};
+
+void to_json(nlohmann::json& j, const PlanEntry& p);
+void from_json(const nlohmann::json& j, PlanEntry& p);
+
+class ScanPlan
+{
+public:
+	ScanPlan() = default;
+	~ScanPlan() = default;
+
+	const std::vector<PlanEntry>& bs() const { return bs_; }
+	const std::vector<PlanEntry>& cs() const { return cs_; }
+	void set_bs(const std::vector<PlanEntry>& entries) { bs_ = entries; }
+	void set_cs(const std::vector<PlanEntry>& entries) { cs_ = entries; }
+	void set_default(int32_t ts_number_size);
+	void load(const std::string& path);
+
+	static uint32_t frequency_khz(int32_t frequency_idx);
+	static PlanEntry entry(int32_t frequency_idx, const std::vector<int32_t>& slots);
+	static int32_t frequency_idx_from_tsid(uint16_t tsid);
+	// transponder within 2MHz of khz, accepts both the IF and the RF frequency, -1 when there is none
+	static int32_t frequency_idx_from_khz(uint32_t khz);
+
+	static constexpr int32_t TRANSPONDER_SIZE_BS = 12;
+	static constexpr int32_t TRANSPONDER_SIZE_CS = 12;
+	static constexpr int32_t SLOT_SIZE = 8;
+	static constexpr uint32_t LNB_LOCAL_KHZ = 10678000;
+
+private:
+
+	std::vector<PlanEntry> bs_;
+	std::vector<PlanEntry> cs_;
+
+	void validate(const std::vector<PlanEntry>& entries, bool is_bs) const;
+};
+
+}
@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+
+namespace px4tsid
+{
+
+namespace
+{
+
+// upper bound of one poll() so that a cancel from a signal handler is noticed
+constexpr std::chrono::milliseconds CANCEL_POLL_INTERVAL{100};
+
+}
+
+HelperThread::HelperThread()
+{
+	thread_ = std::thread([this] { loop(); });
+}
+
+HelperThread::~HelperThread()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		is_stopping_ = true;
+	}
+	posted_.notify_one();
+	thread_.join();
+}
+
+void HelperThread::post(Job& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		job.next_ = nullptr;
+		job.is_done_ = false;
+		if (tail_ != nullptr)
+		{
+			tail_->next_ = &job;
+		}
+		else
+		{
+			head_ = &job;
+		}
+		tail_ = &job;
+	}
+	posted_.notify_one();
+}
+
+void HelperThread::wait(Job& job)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	done_.wait(lock, [&job] { return job.is_done_; });
+}
+
+void HelperThread::loop()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true)
+	{
+		posted_.wait(lock, [this] { return head_ != nullptr || is_stopping_; });
+		if (head_ == nullptr)
+		{
+			break;
+		}
+		auto job = head_;
+		head_ = job->next_;
+		if (head_ == nullptr)
+		{
+			tail_ = nullptr;
+		}
+
+		lock.unlock();
+		job->run_(*job);
+		lock.lock();
+		// the owner may free job as soon as this is set
+		job->is_done_ = true;
+		done_.notify_all();
+	}
+}
+
+Scheduler::Scheduler()
+{
+	event_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (event_fd_ == -1)
+	{
+		throw std::runtime_error("failed to eventfd");
+	}
+}
+
+Scheduler::~Scheduler()
+{
+	::close(event_fd_);
+}
+
+void Scheduler::run()
+{
+	for (auto& task : tasks_)
+	{
+		ready_.push_back(task.handle());
+	}
+
+	while (true)
+	{
+		while (!ready_.empty())
+		{
+			auto handle = ready_.front();
+			ready_.pop_front();
+			handle.resume();
+		}
+
+		if (std::all_of(tasks_.begin(), tasks_.end(), [](const Task<void>& t) { return t.done(); }))
+		{
+			break;
+		}
+		if (waiters_.empty() && blocking_count_ == 0)
+		{
+			throw std::logic_error("scheduler stalled");
+		}
+		poll_once();
+	}
+
+	auto tasks = std::move(tasks_);
+	for (auto& task : tasks)
+	{
+		task.handle().promise().result();
+	}
+}
+
+void Scheduler::wait(int32_t fd, clock::time_point deadline, std::coroutine_handle<> handle, bool* is_readable,
+	const CancelToken* cancel)
+{
+	waiters_.push_back({ fd, deadline, handle, is_readable, cancel });
+}
+
+void Scheduler::end_blocking(std::coroutine_handle<> handle)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	completed_.push_back(handle);
+	uint64_t one = 1;
+	while (::write(event_fd_, &one, sizeof(one)) == -1 && errno == EINTR) {}
+}
+
+void Scheduler::poll_once()
+{
+	pfds_.clear();
+	pfds_.push_back({ event_fd_, POLLIN, 0 });
+	auto deadline = clock::time_point::max();
+	for (const auto& w : waiters_)
+	{
+		if (w.fd != -1)
+		{
+			pfds_.push_back({ w.fd, POLLIN, 0 });
+		}
+		deadline = std::min(deadline, w.deadline);
+		if (w.cancel != nullptr && w.cancel->is_cancelled())
+		{
+			// cancelled by another task since it was suspended
+			deadline = clock::time_point();
+		}
+	}
+
+	auto timeout = -1;
+	if (deadline != clock::time_point::max())
+	{
+		auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - clock::now());
+		timeout = static_cast<int>(std::max<int64_t>(left.count(), 0));
+	}
+	if (cancel_ != nullptr && (timeout == -1 || timeout > CANCEL_POLL_INTERVAL.count()))
+	{
+		timeout = CANCEL_POLL_INTERVAL.count();
+	}
+
+	auto ret = ::poll(pfds_.data(), pfds_.size(), timeout);
+	if (ret == -1 && errno != EINTR)
+	{
+		throw std::runtime_error("failed to poll");
+	}
+
+	if (ret > 0 && pfds_.front().revents != 0)
+	{
+		uint64_t count;
+		while (::read(event_fd_, &count, sizeof(count)) == -1 && errno == EINTR) {}
+		std::lock_guard<std::mutex> lock(mutex_);
+		blocking_count_ -= completed_.size();
+		ready_.insert(ready_.end(), completed_.begin(), completed_.end());
+		completed_.clear();
+	}
+
+	auto now = clock::now();
+	auto is_cancelled = cancel_ != nullptr && cancel_->is_cancelled();
+	size_t i = 1;
+	waiting_.clear();
+	for (const auto& w : waiters_)
+	{
+		auto is_readable = false;
+		if (w.fd != -1)
+		{
+			is_readable = ret > 0 && pfds_.at(i).revents != 0;
+			i++;
+		}
+		if (is_readable || now >= w.deadline || is_cancelled || (w.cancel != nullptr && w.cancel->is_cancelled()))
+		{
+			if (w.is_readable != nullptr)
+			{
+				*w.is_readable = is_readable;
+			}
+			ready_.push_back(w.handle);
+		}
+		else
+		{
+			waiting_.push_back(w);
+		}
+	}
+	waiters_.swap(waiting_);
+}
+
+}
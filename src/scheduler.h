@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <poll.h>
+
+#include <cstdint>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cancel_token.h"
+#include "task.h"
+
+namespace px4tsid
+{
+
+// Long-lived thread that runs the blocking() calls of a task one after
+// another. Jobs live in the awaiting coroutine frame and are queued
+// intrusively, so handing one over neither starts a thread nor allocates.
+class HelperThread
+{
+public:
+	class Job
+	{
+	public:
+		explicit Job(void (*run)(Job&)) : run_(run) {}
+
+	private:
+		friend class HelperThread;
+		void (*run_)(Job&);
+		Job* next_ = nullptr;
+		bool is_done_ = false;
+	};
+
+	HelperThread();
+	~HelperThread();
+	HelperThread(const HelperThread&) = delete;
+	HelperThread& operator=(const HelperThread&) = delete;
+
+	void post(Job& job);
+	// returns once job has run
+	void wait(Job& job);
+
+private:
+	std::mutex mutex_;
+	std::condition_variable posted_;
+	std::condition_variable done_;
+	Job* head_ = nullptr;
+	Job* tail_ = nullptr;
+	bool is_stopping_ = false;
+	std::thread thread_;
+
+	void loop();
+};
+
+// Runs coroutine tasks on the calling thread. Tasks suspend on a file
+// descriptor or a point in time and are resumed by a single poll() loop.
+// Driver calls that cannot be made non-blocking (ioctls waiting for lock)
+// go to a HelperThread with blocking(), so one tuner's tuning overlaps
+// with another's reads and parsing.
+class Scheduler
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	Scheduler();
+	~Scheduler();
+	Scheduler(const Scheduler&) = delete;
+	Scheduler& operator=(const Scheduler&) = delete;
+
+	// wakes every suspended task when the token is cancelled
+	void set_cancel(const CancelToken* cancel) { cancel_ = cancel; }
+	void spawn(Task<void> task) { tasks_.push_back(std::move(task)); }
+	// runs until every spawned task finishes, then rethrows the first failure
+	void run();
+
+	class SleepAwaiter
+	{
+	public:
+		SleepAwaiter(Scheduler& scheduler, clock::time_point time, const CancelToken* cancel)
+			: scheduler_(scheduler), time_(time), cancel_(cancel) {}
+		bool await_ready() const { return clock::now() >= time_ || (cancel_ != nullptr && cancel_->is_cancelled()); }
+		void await_suspend(std::coroutine_handle<> handle) { scheduler_.wait(-1, time_, handle, nullptr, cancel_); }
+		void await_resume() const {}
+
+	private:
+		Scheduler& scheduler_;
+		clock::time_point time_;
+		const CancelToken* cancel_;
+	};
+
+	class ReadableAwaiter
+	{
+	public:
+		ReadableAwaiter(Scheduler& scheduler, int32_t fd, clock::time_point deadline, const CancelToken* cancel)
+			: scheduler_(scheduler), fd_(fd), deadline_(deadline), cancel_(cancel) {}
+		bool await_ready() const { return false; }
+		void await_suspend(std::coroutine_handle<> handle) { scheduler_.wait(fd_, deadline_, handle, &is_readable_, cancel_); }
+		bool await_resume() const { return is_readable_; }
+
+	private:
+		Scheduler& scheduler_;
+		int32_t fd_;
+		clock::time_point deadline_;
+		const CancelToken* cancel_;
+		bool is_readable_ = false;
+	};
+
+	template <typename F>
+	class BlockingAwaiter : private HelperThread::Job
+	{
+	public:
+		using result_type = std::invoke_result_t<F>;
+
+		BlockingAwaiter(Scheduler& scheduler, HelperThread& helper, F&& f)
+			: HelperThread::Job(&BlockingAwaiter::run), scheduler_(scheduler), helper_(helper), f_(std::forward<F>(f)) {}
+		~BlockingAwaiter()
+		{
+			// only when the task is destroyed while f runs, e.g. another task failed
+			if (is_posted_) { helper_.wait(*this); }
+		}
+		bool await_ready() const { return false; }
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			handle_ = handle;
+			scheduler_.begin_blocking();
+			is_posted_ = true;
+			helper_.post(*this);
+		}
+		result_type await_resume()
+		{
+			if (exception_) { std::rethrow_exception(exception_); }
+			if constexpr (!std::is_void_v<result_type>)
+			{
+				return std::move(*result_);
+			}
+		}
+
+	private:
+		struct Empty {};
+		using storage_type = std::conditional_t<std::is_void_v<result_type>, Empty, result_type>;
+
+		Scheduler& scheduler_;
+		HelperThread& helper_;
+		F f_;
+		std::coroutine_handle<> handle_;
+		bool is_posted_ = false;
+		std::optional<storage_type> result_;
+		std::exception_ptr exception_;
+
+		// on the helper thread
+		static void run(HelperThread::Job& job)
+		{
+			auto& self = static_cast<BlockingAwaiter&>(job);
+			try
+			{
+				if constexpr (std::is_void_v<result_type>)
+				{
+					self.f_();
+				}
+				else
+				{
+					self.result_.emplace(self.f_());
+				}
+			}
+			catch (...)
+			{
+				self.exception_ = std::current_exception();
+			}
+			self.scheduler_.end_blocking(self.handle_);
+		}
+	};
+
+	// cancel is checked in addition to the token of set_cancel(), it wakes only this task
+	SleepAwaiter sleep_until(clock::time_point time, const CancelToken* cancel = nullptr) { return SleepAwaiter(*this, time, cancel); }
+	SleepAwaiter sleep_for(std::chrono::milliseconds duration) { return SleepAwaiter(*this, clock::now() + duration, nullptr); }
+	// resumes with true when fd is readable, false at the deadline or on cancel
+	ReadableAwaiter readable(int32_t fd, clock::time_point deadline, const CancelToken* cancel = nullptr)
+	{
+		return ReadableAwaiter(*this, fd, deadline, cancel);
+	}
+	// runs f on helper and resumes with its result or exception
+	template <typename F>
+	BlockingAwaiter<F> blocking(HelperThread& helper, F&& f) { return BlockingAwaiter<F>(*this, helper, std::forward<F>(f)); }
+
+private:
+	struct Waiter
+	{
+		int32_t fd;
+		clock::time_point deadline;
+		std::coroutine_handle<> handle;
+		bool* is_readable;
+		const CancelToken* cancel;
+	};
+
+	const CancelToken* cancel_ = nullptr;
+	std::vector<Task<void>> tasks_;
+	std::deque<std::coroutine_handle<>> ready_;
+	std::vector<Waiter> waiters_;
+	// reused by every poll_once() so that the loop does not allocate once warmed up
+	std::vector<::pollfd> pfds_;
+	std::vector<Waiter> waiting_;
+	int32_t event_fd_ = -1;
+	int32_t blocking_count_ = 0;
+	std::mutex mutex_;
+	std::vector<std::coroutine_handle<>> completed_;
+
+	void wait(int32_t fd, clock::time_point deadline, std::coroutine_handle<> handle, bool* is_readable,
+		const CancelToken* cancel = nullptr);
+	void begin_blocking() { blocking_count_++; }
+	void end_blocking(std::coroutine_handle<> handle);
+	void poll_once();
+};
+
+}
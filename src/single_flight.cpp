@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.hpp"
+
+#include "cancel_token.h"
+#include "config.h"
+#include "logger.h"
+#include "probe.h"
+#include "single_flight.h"
+#include "tsid_scan.h"
+
+namespace px4tsid
+{
+
+namespace
+{
+
+int64_t now_ms()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// stable across builds, unlike std::hash
+std::string fnv1a(const std::string& text)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+	for (auto c : text)
+	{
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 0x100000001b3;
+	}
+	char hex[17];
+	std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+	return hex;
+}
+
+std::string path_of(const nlohmann::json& key, const char* suffix)
+{
+	auto cache = Probe::cache_path();
+	if (cache.empty())
+	{
+		return "";
+	}
+	return cache.substr(0, cache.rfind('/') + 1) + "singleflight-" + fnv1a(key.dump()) + suffix;
+}
+
+}
+
+SingleFlight::~SingleFlight()
+{
+	unlock();
+}
+
+void SingleFlight::init(const Config& config)
+{
+	key_ = key(config);
+}
+
+std::optional<nlohmann::json> SingleFlight::join(const CancelToken& cancel)
+{
+	if (fd_ != -1)
+	{
+		throw std::logic_error("already joined");
+	}
+
+	// a result published before this point belongs to an earlier scan
+	auto since = now_ms();
+	auto path = lock_path(key_);
+	if (path.empty())
+	{
+		throw std::runtime_error("no cache directory for --singleflight");
+	}
+	if (!Probe::make_cache_dir(path))
+	{
+		throw std::runtime_error("failed to create " + path.substr(0, path.rfind('/')));
+	}
+	fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd_ == -1)
+	{
+		throw std::runtime_error("failed to open " + path);
+	}
+
+	if (::flock(fd_, LOCK_EX | LOCK_NB) == 0)
+	{
+		return std::nullopt;
+	}
+	if (errno != EWOULDBLOCK)
+	{
+		throw std::runtime_error("failed to lock " + path);
+	}
+
+	PX4TSID_LOG(LogLevel::info, "another px4tsid is scanning, wait for its result");
+	while (::flock(fd_, LOCK_EX | LOCK_NB) == -1)
+	{
+		if (errno != EWOULDBLOCK && errno != EINTR)
+		{
+			throw std::runtime_error("failed to lock " + path);
+		}
+		if (cancel.is_cancelled())
+		{
+			throw std::runtime_error("catch signal");
+		}
+		std::this_thread::sleep_for(POLL_INTERVAL);
+	}
+
+	auto table = load_result(since);
+	if (!table)
+	{
+		PX4TSID_LOG(LogLevel::info, "the other px4tsid published no result, scan");
+		return std::nullopt;
+	}
+	unlock();
+	PX4TSID_LOG(LogLevel::info, "use the result of the other px4tsid");
+	return table;
+}
+
+void SingleFlight::publish(const TSIDScan& scan)
+{
+	if (fd_ == -1)
+	{
+		return;
+	}
+
+	// renamed into place, a waiter never reads a partial file
+	auto path = result_path(key_);
+	auto tmp = path + ".tmp";
+	{
+		std::ofstream ofs(tmp);
+		ofs << "{\"key\":" << key_.dump() << ",\"finished_ms\":" << now_ms() << ",\"table\":";
+		scan.write_json(ofs);
+		ofs << "}\n";
+		if (!ofs)
+		{
+			PX4TSID_LOG(LogLevel::warn, "failed to write %s", tmp.c_str());
+		}
+		else if (std::rename(tmp.c_str(), path.c_str()) != 0)
+		{
+			PX4TSID_LOG(LogLevel::warn, "failed to write %s", path.c_str());
+		}
+	}
+	unlock();
+}
+
+nlohmann::json SingleFlight::key(const Config& config)
+{
+	auto devices = config.devices();
+	std::sort(devices.begin(), devices.end());
+	std::vector<uint16_t> ignore;
+	for (uint32_t tsid = 0; tsid <= 0xffff; tsid++)
+	{
+		if (config.is_ignore_tsid(tsid))
+		{
+			ignore.push_back(tsid);
+		}
+	}
+
+	return nlohmann::json{
+		{"devices", devices},
+		{"plan", config.plan()},
+		{"ts_number_size", config.ts_number_size()},
+		{"lnb", config.lnb_power()},
+		{"delivery_system", config.delivery_system()},
+		{"ignore", ignore},
+		{"stats", config.is_stats()},
+		{"stats_window", config.stats_window().count()},
+		// a scan cut short by a budget is only the answer for the same budget
+		{"scan_timeout", config.scan_timeout().count()},
+		{"time_budget", config.time_budget().count()},
+	};
+}
+
+std::string SingleFlight::lock_path(const nlohmann::json& key)
+{
+	return path_of(key, ".lock");
+}
+
+std::string SingleFlight::result_path(const nlohmann::json& key)
+{
+	return path_of(key, ".json");
+}
+
+std::optional<nlohmann::json> SingleFlight::load_result(int64_t since_ms) const
+{
+	std::ifstream ifs(result_path(key_));
+	if (!ifs)
+	{
+		return std::nullopt;
+	}
+	auto j = nlohmann::json::parse(ifs, nullptr, false);
+	if (!j.is_object() || j.value("key", nlohmann::json()) != key_ || j.value("finished_ms", int64_t(0)) < since_ms
+		|| !j.contains("table"))
+	{
+		return std::nullopt;
+	}
+	return j.at("table");
+}
+
+void SingleFlight::unlock()
+{
+	if (fd_ == -1) { return; }
+
+	::close(fd_);
+	fd_ = -1;
+}
+
+}
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <optional>
+#include <string>
+
+#include "json.hpp"
+
+#include "cancel_token.h"
+#include "config.h"
+#include "tsid_scan.h"
+
+namespace px4tsid
+{
+
+// Lets px4tsid invocations started at the same moment on the same DEVICEs
+// share one scan. The first one takes an flock on a lock file in the cache
+// directory and scans, the others wait for the lock and take the table the
+// first one published meanwhile. A scan that fails or is cancelled publishes
+// nothing and releases the lock on exit, so the next waiter scans itself.
+class SingleFlight
+{
+public:
+	// how often a waiter checks for the lock and its cancel token
+	static constexpr std::chrono::milliseconds POLL_INTERVAL{100};
+
+	SingleFlight() = default;
+	~SingleFlight();
+	SingleFlight(const SingleFlight&) = delete;
+	SingleFlight& operator=(const SingleFlight&) = delete;
+
+	void init(const Config& config);
+	// returns the table another invocation scanned while this one waited,
+	// nullopt when this one holds the lock and has to scan
+	std::optional<nlohmann::json> join(const CancelToken& cancel);
+	// hands the table to the waiters and releases the lock
+	void publish(const TSIDScan& scan);
+
+	// same scan options give the same key, output options do not matter
+	static nlohmann::json key(const Config& config);
+	static std::string lock_path(const nlohmann::json& key);
+	static std::string result_path(const nlohmann::json& key);
+
+private:
+	nlohmann::json key_;
+	int32_t fd_ = -1;
+
+	std::optional<nlohmann::json> load_result(int64_t since_ms) const;
+	void unlock();
+};
+
+}
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.hpp"
+
+#include "cancel_token.h"
+#include "chset.h"
+#include "config.h"
+#include "logger.h"
+#include "scan_plan.h"
+#include "sweep.h"
+#include "ts_parser.h"
+#include "tsid_scan.h"
+#include "tuner.h"
+#include "tuner_pool.h"
+
+namespace px4tsid
+{
+
+void to_json(nlohmann::json& j, const Sweep::Carrier& p)
+{
+	j = nlohmann::json{
+		{"band", p.band},
+		{"transponder", p.transponder},
+		{"frequency_idx", p.frequency_idx},
+		{"frequency_khz", p.frequency_khz},
+		{"frequency_if_khz", p.frequency_khz - ScanPlan::LNB_LOCAL_KHZ},
+		{"lock_from_khz", p.lock_from_khz},
+		{"lock_to_khz", p.lock_to_khz},
+		{"transport_stream_id", p.transport_stream_id},
+		{"slot_status", p.slot_status},
+	};
+}
+
+void Sweep::sweep(const CancelToken& cancel)
+{
+	cancel_ = &cancel;
+	carriers_.clear();
+	if (!tuner_factory_)
+	{
+		tuner_factory_ = [this] { return make_tuner(config_); };
+	}
+
+	TunerPool tuner_pool;
+	tuner_pool.set_devices(config_.devices());
+	tuner_pool.set_busy_wait(config_.busy_wait());
+	tuner_pool.set_max_failures(config_.max_failures());
+	tuner_ = tuner_factory_();
+	tuner_->set_lnb_power(config_.lnb_power());
+	tuner_->set_timeout(config_.io_timeout());
+	tuner_->set_cancel(cancel_);
+	tuner_pool.acquire(*tuner_, cancel_);
+	PX4TSID_LOG(LogLevel::info, "use %s", tuner_->device().c_str());
+	buf_.resize(config_.buffer_size());
+
+	try
+	{
+		scan_range();
+	}
+	catch (...)
+	{
+		tuner_pool.release(*tuner_, true);
+		tuner_.reset();
+		cancel_ = nullptr;
+		throw;
+	}
+	tuner_pool.release(*tuner_);
+	tuner_.reset();
+	cancel_ = nullptr;
+}
+
+nlohmann::json Sweep::json() const
+{
+	auto j = nlohmann::json::array();
+	for (const auto& c : carriers_)
+	{
+		j.emplace_back(c);
+	}
+	return j;
+}
+
+void Sweep::scan_range()
+{
+	auto step = config_.sweep_step_khz();
+	for (auto khz = config_.sweep_from_khz(); khz <= config_.sweep_to_khz() && !is_cancelled(); )
+	{
+		if (!try_lock(khz))
+		{
+			khz += step;
+			continue;
+		}
+
+		// a carrier is narrower than its symbol rate, whatever the tuner claims to lock on
+		auto last = khz;
+		while (last + step - khz < SYMBOL_RATE_KHZ && !is_cancelled() && try_lock(last + step))
+		{
+			last += step;
+		}
+
+		Carrier carrier;
+		carrier.lock_from_khz = find_edge(khz, khz - step);
+		carrier.lock_to_khz = find_edge(last, last + step);
+		if (is_cancelled())
+		{
+			break;
+		}
+		locate(carrier);
+		PX4TSID_LOG(LogLevel::info, "%u(%u) : locked from %u to %u", carrier.frequency_khz, carrier.frequency_khz - ScanPlan::LNB_LOCAL_KHZ,
+			carrier.lock_from_khz, carrier.lock_to_khz);
+		auto slots = carrier.band == "CS" ? 1 : config_.ts_number_size();
+		carrier.transport_stream_id.assign(slots, 0xffff);
+		carrier.slot_status.assign(slots, SlotStatus::unprobed);
+		for (auto tsnum = 0; tsnum < slots && !is_cancelled(); tsnum++)
+		{
+			read_slot(carrier, tsnum);
+		}
+
+		// the next carrier is a symbol rate away at least and locks about as far from its centre as this one
+		auto centre = carrier.lock_from_khz / 2 + carrier.lock_to_khz / 2;
+		auto next = centre + SYMBOL_RATE_KHZ - (carrier.lock_to_khz - carrier.lock_from_khz) / 2;
+		khz = last + step;
+		if (next > khz)
+		{
+			khz += (next - khz) / step * step;
+		}
+		carriers_.push_back(std::move(carrier));
+	}
+}
+
+bool Sweep::try_lock(uint32_t khz)
+{
+	tuner_->set_deadline(Tuner::clock::now() + std::min(LOCK_TIMEOUT, config_.io_timeout()));
+	try
+	{
+		tuner_->set_frequency_s(khz, 0);
+		PX4TSID_LOG(LogLevel::debug, "%u(%u) : locked", khz, khz - ScanPlan::LNB_LOCAL_KHZ);
+		return true;
+	}
+	catch (const std::runtime_error& e)
+	{
+		PX4TSID_LOG(LogLevel::debug, "%u(%u) : %s", khz, khz - ScanPlan::LNB_LOCAL_KHZ, e.what());
+		return false;
+	}
+}
+
+// bisects between a frequency that locks and one that does not, returns the last one that locks
+uint32_t Sweep::find_edge(uint32_t locked, uint32_t unlocked)
+{
+	while ((locked > unlocked ? locked - unlocked : unlocked - locked) > FINE_STEP_KHZ && !is_cancelled())
+	{
+		auto middle = locked / 2 + unlocked / 2;
+		if (try_lock(middle))
+		{
+			locked = middle;
+		}
+		else
+		{
+			unlocked = middle;
+		}
+	}
+	return locked;
+}
+
+void Sweep::locate(Carrier& carrier) const
+{
+	carrier.frequency_khz = carrier.lock_from_khz / 2 + carrier.lock_to_khz / 2;
+	carrier.frequency_idx = ScanPlan::frequency_idx_from_khz(carrier.frequency_khz);
+	if (carrier.frequency_idx == -1)
+	{
+		return;
+	}
+
+	// the nominal frequency of a known transponder is closer than the bisection gets
+	auto entry = ScanPlan::entry(carrier.frequency_idx, {});
+	carrier.frequency_khz = entry.frequency_khz();
+	carrier.band = carrier.frequency_idx < ScanPlan::TRANSPONDER_SIZE_BS ? "BS" : "CS";
+	carrier.transponder = entry.transponder();
+}
+
+void Sweep::read_slot(Carrier& carrier, int32_t tsnum)
+{
+	using namespace std::chrono_literals;
+	auto status = SlotStatus::not_found;
+	uint16_t pat_tsid = 0xffff;
+	std::string error;
+
+	tuner_->set_deadline(Tuner::clock::now() + config_.slot_timeout());
+	ts_parser_.clear();
+	try
+	{
+		tuner_->set_frequency_s(carrier.frequency_khz, tsnum);
+		tuner_->start_streaming();
+		for (auto retry = 0; retry < config_.retry_count() * config_.reads_per_retry() && !is_cancelled(); retry++)
+		{
+			auto size = tuner_->read_stream(buf_.data(), buf_.size());
+			if (size <= 0)
+			{
+				std::this_thread::sleep_for(100ms);
+				continue;
+			}
+			uint16_t tsid = 0xffff;
+			ts_parser_.get_transport_stream_id(buf_.data(), size, tsid);
+			if (tsid != 0xffff && !config_.is_ignore_tsid(tsid))
+			{
+				pat_tsid = tsid;
+				break;
+			}
+		}
+	}
+	catch (const TimeoutError& e)
+	{
+		error = e.what();
+		status = SlotStatus::timeout;
+	}
+	catch (const std::runtime_error& e)
+	{
+		error = e.what();
+		status = SlotStatus::error;
+	}
+	tuner_->stop_streaming();
+
+	// an unused slot delivers the first TS of the carrier again
+	const auto& tsids = carrier.transport_stream_id;
+	if (pat_tsid != 0xffff && std::find(tsids.begin(), tsids.end(), pat_tsid) == tsids.end())
+	{
+		carrier.transport_stream_id.at(tsnum) = pat_tsid;
+		status = SlotStatus::found;
+	}
+	if (is_cancelled() && status != SlotStatus::found)
+	{
+		status = SlotStatus::unprobed;
+	}
+	carrier.slot_status.at(tsnum) = status;
+
+	if (logger().is_enabled(LogLevel::info))
+	{
+		char tsid_text[32] = "";
+		if (pat_tsid != 0xffff)
+		{
+			std::snprintf(tsid_text, sizeof(tsid_text), " : TSID = %u", pat_tsid);
+		}
+		auto name = carrier.transponder.empty() ? std::to_string(carrier.frequency_khz) : carrier.transponder;
+		logger().log(LogLevel::info, "%s/TS%d : Frequency = %u(%u)%s%s%s", name.c_str(), tsnum,
+			carrier.frequency_khz, carrier.frequency_khz - ScanPlan::LNB_LOCAL_KHZ, tsid_text,
+			error.empty() ? "" : " : ", error.c_str());
+	}
+}
+
+}
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "cancel_token.h"
+#include "chset.h"
+#include "config.h"
+#include "ts_parser.h"
+#include "tsid_scan.h"
+#include "tuner.h"
+
+namespace px4tsid
+{
+
+// Blind scan for ISDB-S carriers the BS/CS frequency_idx formulas do not
+// cover, e.g. a dish aimed at another satellite. The range is stepped
+// coarsely with a short lock timeout, both edges of every lock range are
+// bisected down to FINE_STEP_KHZ and the PATs are read at its centre.
+// Carriers on one polarization are at least a symbol rate apart, so the
+// coarse steps right after a carrier are skipped.
+class Sweep
+{
+public:
+	struct Carrier
+	{
+		uint32_t frequency_khz = 0;
+		uint32_t lock_from_khz = 0;
+		uint32_t lock_to_khz = 0;
+		// BS/CS transponder the carrier is on, -1 for any other
+		int32_t frequency_idx = -1;
+		std::string band;
+		std::string transponder;
+		std::vector<uint16_t> transport_stream_id;
+		std::vector<SlotStatus> slot_status;
+	};
+
+	// an empty step costs this much at most, a carrier locks well within it
+	static constexpr std::chrono::milliseconds LOCK_TIMEOUT{1000};
+	static constexpr uint32_t FINE_STEP_KHZ = 250;
+	static constexpr uint32_t SYMBOL_RATE_KHZ = 28860;
+
+	Sweep() = default;
+	~Sweep() = default;
+
+	void init(const Config& config) { config_ = config; }
+	void set_tuner_factory(const TunerFactory& factory) { tuner_factory_ = factory; }
+	void sweep(const CancelToken& cancel);
+	const std::vector<Carrier>& carriers() const { return carriers_; }
+	nlohmann::json json() const;
+
+private:
+	Config config_;
+	TunerFactory tuner_factory_;
+	std::unique_ptr<Tuner> tuner_;
+	TSParser ts_parser_;
+	std::vector<uint8_t> buf_;
+	const CancelToken* cancel_ = nullptr;
+	std::vector<Carrier> carriers_;
+
+	bool is_cancelled() const { return cancel_ != nullptr && cancel_->is_cancelled(); }
+	void scan_range();
+	bool try_lock(uint32_t khz);
+	uint32_t find_edge(uint32_t locked, uint32_t unlocked);
+	void locate(Carrier& carrier) const;
+	void read_slot(Carrier& carrier, int32_t tsnum);
+};
+
+void to_json(nlohmann::json& j, const Sweep::Carrier& p);
+
+}
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace px4tsid
+{
+
+template <typename T>
+class Task;
+
+namespace detail
+{
+
+struct TaskPromiseBase
+{
+	struct FinalAwaiter
+	{
+		bool await_ready() const noexcept { return false; }
+		template <typename P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept { return h.promise().continuation; }
+		void await_resume() const noexcept {}
+	};
+
+	std::coroutine_handle<> continuation = std::noop_coroutine();
+	std::exception_ptr exception;
+
+	std::suspend_always initial_suspend() const noexcept { return {}; }
+	FinalAwaiter final_suspend() const noexcept { return {}; }
+	void unhandled_exception() { exception = std::current_exception(); }
+	void rethrow_if_failed() const
+	{
+		if (exception) { std::rethrow_exception(exception); }
+	}
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase
+{
+	std::optional<T> value;
+
+	void return_value(T v) { value = std::move(v); }
+	T result()
+	{
+		rethrow_if_failed();
+		return std::move(*value);
+	}
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+	void return_void() const noexcept {}
+	void result() const { rethrow_if_failed(); }
+};
+
+}
+
+// Lazily started coroutine. Awaiting it runs the body and resumes the
+// awaiting coroutine when the body finishes, rethrowing its exception.
+template <typename T = void>
+class Task
+{
+public:
+	struct promise_type : detail::TaskPromise<T>
+	{
+		Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+	};
+
+	Task() = default;
+	Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+	Task& operator=(Task&& other) noexcept
+	{
+		if (this != &other)
+		{
+			destroy();
+			handle_ = std::exchange(other.handle_, nullptr);
+		}
+		return *this;
+	}
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+	~Task() { destroy(); }
+
+	bool done() const { return !handle_ || handle_.done(); }
+	std::coroutine_handle<promise_type> handle() const { return handle_; }
+
+	bool await_ready() const noexcept { return false; }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+	{
+		handle_.promise().continuation = continuation;
+		return handle_;
+	}
+	T await_resume() { return handle_.promise().result(); }
+
+private:
+	std::coroutine_handle<promise_type> handle_;
+
+	explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+	void destroy()
+	{
+		if (handle_)
+		{
+			handle_.destroy();
+			handle_ = nullptr;
+		}
+	}
+};
+
+}
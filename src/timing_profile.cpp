@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdio>
+
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+#include "json.hpp"
+
+#include "logger.h"
+#include "timing_profile.h"
+
+namespace px4tsid
+{
+
+namespace
+{
+
+bool is_valid_entry(const nlohmann::json& e)
+{
+	if (!e.is_object() || !e.contains("device") || !e.at("device").is_string())
+	{
+		return false;
+	}
+	for (const auto& key : {"frequency_idx", "slot", "samples", "successes"})
+	{
+		if (!e.contains(key) || !e.at(key).is_number_integer())
+		{
+			return false;
+		}
+	}
+	for (const auto& key : {"failure_rate", "lock_ms", "pat_ms"})
+	{
+		if (!e.contains(key) || !e.at(key).is_number())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+
+void TimingProfile::load(const std::string& path)
+{
+	entries_.clear();
+	std::ifstream ifs(path);
+	if (!ifs)
+	{
+		// first run, nothing learned yet
+		return;
+	}
+
+	// a corrupt or older profile is relearned rather than stopping every later scan
+	auto j = nlohmann::json::parse(ifs, nullptr, false);
+	if (!j.is_object() || !j.contains("slots") || !j.at("slots").is_array())
+	{
+		PX4TSID_LOG(LogLevel::warn, "ignore invalid profile %s", path.c_str());
+		return;
+	}
+	for (const auto& e : j.at("slots"))
+	{
+		if (!is_valid_entry(e))
+		{
+			PX4TSID_LOG(LogLevel::warn, "ignore invalid profile %s", path.c_str());
+			entries_.clear();
+			return;
+		}
+		Entry entry;
+		entry.samples = e.at("samples");
+		entry.successes = e.at("successes");
+		entry.failure_rate = e.at("failure_rate");
+		entry.lock_ms = e.at("lock_ms");
+		entry.pat_ms = e.at("pat_ms");
+		entries_[Key(e.at("device"), e.at("frequency_idx"), e.at("slot"))] = entry;
+	}
+}
+
+void TimingProfile::save(const std::string& path) const
+{
+	auto slots = nlohmann::json::array();
+	for (const auto& [key, entry] : entries_)
+	{
+		slots.push_back({
+			{"device", std::get<0>(key)},
+			{"frequency_idx", std::get<1>(key)},
+			{"slot", std::get<2>(key)},
+			{"samples", entry.samples},
+			{"successes", entry.successes},
+			{"failure_rate", entry.failure_rate},
+			{"lock_ms", entry.lock_ms},
+			{"pat_ms", entry.pat_ms},
+		});
+	}
+
+	auto tmp = path + ".tmp";
+	{
+		std::ofstream ofs(tmp);
+		if (!ofs)
+		{
+			throw std::runtime_error("failed to write profile " + tmp);
+		}
+		ofs << nlohmann::json{ {"slots", slots} }.dump(4) << '\n';
+		if (!ofs)
+		{
+			throw std::runtime_error("failed to write profile " + tmp);
+		}
+	}
+	if (std::rename(tmp.c_str(), path.c_str()) != 0)
+	{
+		throw std::runtime_error("failed to write profile " + path);
+	}
+}
+
+const TimingProfile::Entry* TimingProfile::find(const std::string& device, int32_t frequency_idx, int32_t slot) const
+{
+	auto it = entries_.find(Key(device, frequency_idx, slot));
+	return it == entries_.end() ? nullptr : &it->second;
+}
+
+void TimingProfile::update(const std::string& device, int32_t frequency_idx, int32_t slot, bool has_pat,
+	std::chrono::milliseconds lock, std::chrono::milliseconds pat)
+{
+	auto& entry = entries_[Key(device, frequency_idx, slot)];
+	entry.samples++;
+	entry.failure_rate += ALPHA * ((has_pat ? 0.0 : 1.0) - entry.failure_rate);
+	if (!has_pat)
+	{
+		return;
+	}
+
+	if (entry.successes++ == 0)
+	{
+		entry.lock_ms = lock.count();
+		entry.pat_ms = pat.count();
+	}
+	else
+	{
+		entry.lock_ms += ALPHA * (lock.count() - entry.lock_ms);
+		entry.pat_ms += ALPHA * (pat.count() - entry.pat_ms);
+	}
+}
+
+std::chrono::milliseconds TimingProfile::deadline(const std::string& device, int32_t frequency_idx, int32_t slot,
+	std::chrono::milliseconds limit) const
+{
+	auto entry = find(device, frequency_idx, slot);
+	if (entry == nullptr || entry->samples < MIN_SAMPLES)
+	{
+		return limit;
+	}
+
+	if (is_expected(device, frequency_idx, slot))
+	{
+		return learned(entry->lock_ms + entry->pat_ms, limit);
+	}
+
+	// a slot that usually fails gets as long as the slowest working slot of the device needs
+	auto slowest = -1.0;
+	for (const auto& [key, e] : entries_)
+	{
+		if (std::get<0>(key) != device || e.successes == 0) continue;
+		slowest = std::max(slowest, e.lock_ms + e.pat_ms);
+	}
+	return slowest < 0 ? limit : learned(slowest, limit);
+}
+
+bool TimingProfile::is_expected(const std::string& device, int32_t frequency_idx, int32_t slot) const
+{
+	auto entry = find(device, frequency_idx, slot);
+	return entry != nullptr && entry->samples >= MIN_SAMPLES && entry->successes > 0 && entry->failure_rate < 0.5;
+}
+
+double TimingProfile::failure_rate(const std::string& device, int32_t frequency_idx) const
+{
+	auto sum = 0.0;
+	auto count = 0;
+	for (auto it = entries_.lower_bound(Key(device, frequency_idx, 0)); it != entries_.end(); ++it)
+	{
+		if (std::get<0>(it->first) != device || std::get<1>(it->first) != frequency_idx) break;
+		sum += it->second.failure_rate;
+		count++;
+	}
+	return count == 0 ? 0 : sum / count;
+}
+
+std::chrono::milliseconds TimingProfile::learned(double ms, std::chrono::milliseconds limit) const
+{
+	// twice the learned time plus slack for scheduling jitter
+	auto d = std::chrono::milliseconds(static_cast<int64_t>(ms * 2) + 200);
+	return std::min(std::max(d, std::chrono::milliseconds(300)), limit);
+}
+
+}
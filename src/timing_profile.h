@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <map>
+#include <string>
+#include <tuple>
+
+#include "json.hpp"
+
+namespace px4tsid
+{
+
+class TimingProfile
+{
+public:
+	struct Entry
+	{
+		int32_t samples = 0;
+		int32_t successes = 0;
+		double failure_rate = 0;
+		double lock_ms = 0;
+		double pat_ms = 0;
+	};
+
+	TimingProfile() = default;
+	~TimingProfile() = default;
+
+	void load(const std::string& path);
+	void save(const std::string& path) const;
+	bool empty() const { return entries_.empty(); }
+	const Entry* find(const std::string& device, int32_t frequency_idx, int32_t slot) const;
+	void update(const std::string& device, int32_t frequency_idx, int32_t slot, bool has_pat,
+		std::chrono::milliseconds lock, std::chrono::milliseconds pat);
+	std::chrono::milliseconds deadline(const std::string& device, int32_t frequency_idx, int32_t slot,
+		std::chrono::milliseconds limit) const;
+	bool is_expected(const std::string& device, int32_t frequency_idx, int32_t slot) const;
+	double failure_rate(const std::string& device, int32_t frequency_idx) const;
+
+private:
+	using Key = std::tuple<std::string, int32_t, int32_t>;
+
+	static constexpr double ALPHA = 0.3;
+	static constexpr int32_t MIN_SAMPLES = 2;
+
+	std::map<Key, Entry> entries_;
+
+	std::chrono::milliseconds learned(double ms, std::chrono::milliseconds limit) const;
+};
+
+}
@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Static tracepoints for bpftrace/perf/SystemTap, e.g.
+//   bpftrace -e 'usdt:/usr/local/bin/px4tsid:px4tsid:read__start { @s[tid] = nsecs }
+//     usdt:/usr/local/bin/px4tsid:px4tsid:read__done /@s[tid]/ { @us = hist((nsecs - @s[tid]) / 1000); @bytes = hist(arg0) }'
+// A probe is a single nop unless a tracer is attached, and compiles to nothing
+// when <sys/sdt.h> is not available. Arguments must be integers or pointers.
+
+#pragma once
+
+#if defined(PX4TSID_HAVE_SDT)
+#include <sys/sdt.h>
+#define PX4TSID_TRACE(...) STAP_PROBEV(px4tsid, __VA_ARGS__)
+#else
+#define PX4TSID_TRACE(...) do {} while (0)
+#endif
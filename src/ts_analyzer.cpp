@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.hpp"
+
+#include "ts_analyzer.h"
+#include "ts_parser.h"
+
+namespace px4tsid
+{
+
+namespace
+{
+
+constexpr uint64_t PACKET_SIZE = 188;
+
+bool is_sync(const uint8_t* data, uint64_t size, uint64_t pos)
+{
+	// three sync bytes in a row, or up to the end of the file
+	for (auto i = 0; i < 3 && pos + i * PACKET_SIZE < size; i++)
+	{
+		if (data[pos + i * PACKET_SIZE] != 0x47)
+		{
+			return false;
+		}
+	}
+	return pos + PACKET_SIZE <= size;
+}
+
+}
+
+void to_json(nlohmann::json& j, const PATChange& p)
+{
+	j = nlohmann::json{
+		{"offset", p.offset},
+		{"transport_stream_id", p.transport_stream_id},
+		{"version", p.version},
+	};
+}
+
+void TSAnalyzer::analyze(const std::string& path)
+{
+	auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		throw std::runtime_error("failed to open " + path);
+	}
+
+	struct ::stat st;
+	if (::fstat(fd, &st) == -1)
+	{
+		::close(fd);
+		throw std::runtime_error("failed to stat " + path);
+	}
+
+	path_ = path;
+	size_ = st.st_size;
+	packets_ = 0;
+	sync_losses_ = 0;
+	timeline_.clear();
+	if (size_ == 0)
+	{
+		::close(fd);
+		return;
+	}
+
+	auto addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (addr == MAP_FAILED)
+	{
+		throw std::runtime_error("failed to mmap " + path);
+	}
+	::madvise(addr, size_, MADV_SEQUENTIAL | MADV_WILLNEED);
+	auto data = static_cast<const uint8_t*>(addr);
+
+	std::vector<Chunk> chunks((size_ + CHUNK_SIZE - 1) / CHUNK_SIZE);
+	std::atomic<size_t> next(0);
+	auto worker = [&] {
+		for (auto i = next++; i < chunks.size(); i = next++)
+		{
+			auto begin = i * CHUNK_SIZE;
+			auto end = std::min(begin + CHUNK_SIZE, size_);
+			analyze_chunk(data, size_, begin, end, chunks.at(i));
+		}
+	};
+
+	auto threads = threads_ > 0 ? threads_ : std::max(1u, std::thread::hardware_concurrency());
+	threads = std::min<uint64_t>(threads, chunks.size());
+	std::vector<std::thread> workers;
+	for (uint32_t i = 1; i < threads; i++)
+	{
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto& t : workers)
+	{
+		t.join();
+	}
+	::munmap(addr, size_);
+
+	// each chunk starts with its first PAT, keep only the real changes
+	for (const auto& chunk : chunks)
+	{
+		packets_ += chunk.packets;
+		sync_losses_ += chunk.sync_losses;
+		for (const auto& change : chunk.changes)
+		{
+			if (!timeline_.empty()
+				&& timeline_.back().transport_stream_id == change.transport_stream_id
+				&& timeline_.back().version == change.version)
+			{
+				continue;
+			}
+			timeline_.emplace_back(change);
+		}
+	}
+}
+
+nlohmann::json TSAnalyzer::json() const
+{
+	return nlohmann::json{
+		{"file", path_},
+		{"size", size_},
+		{"packets", packets_},
+		{"sync_losses", sync_losses_},
+		{"timeline", timeline_},
+	};
+}
+
+// handles the packets starting in [begin, end), a packet may run into the next chunk
+void TSAnalyzer::analyze_chunk(const uint8_t* data, uint64_t size, uint64_t begin, uint64_t end, Chunk& chunk)
+{
+	auto pos = begin;
+	auto has_sync = false;
+	while (pos < end)
+	{
+		// a stray 0x47 is no packet start unless the next packet starts after it
+		auto is_next_sync = pos + PACKET_SIZE >= size || data[pos + PACKET_SIZE] == 0x47;
+		if (data[pos] != 0x47 || !is_next_sync || !has_sync)
+		{
+			if (!is_sync(data, size, pos))
+			{
+				if (has_sync)
+				{
+					chunk.sync_losses++;
+					has_sync = false;
+				}
+				pos++;
+				continue;
+			}
+			has_sync = true;
+		}
+
+		if (pos + PACKET_SIZE > size)
+		{
+			break;
+		}
+
+		auto p = data + pos;
+		uint16_t tsid;
+		uint8_t version;
+		if (!(p[1] & 0x80) && TSParser::parse_pat(p, tsid, version))
+		{
+			if (chunk.changes.empty()
+				|| chunk.changes.back().transport_stream_id != tsid
+				|| chunk.changes.back().version != version)
+			{
+				chunk.changes.push_back({ pos, tsid, version });
+			}
+		}
+		chunk.packets++;
+		pos += PACKET_SIZE;
+	}
+}
+
+}
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+namespace px4tsid
+{
+
+struct PATChange
+{
+	uint64_t offset;
+	uint16_t transport_stream_id;
+	uint8_t version;
+};
+
+void to_json(nlohmann::json& j, const PATChange& p);
+
+// finds where the PAT TSID or version changes in a recorded TS file
+class TSAnalyzer
+{
+public:
+	TSAnalyzer() = default;
+	~TSAnalyzer() = default;
+
+	void set_threads(uint32_t threads) { threads_ = threads; }
+	void analyze(const std::string& path);
+	uint64_t size() const { return size_; }
+	uint64_t packets() const { return packets_; }
+	uint64_t sync_losses() const { return sync_losses_; }
+	const std::vector<PATChange>& timeline() const { return timeline_; }
+	nlohmann::json json() const;
+
+private:
+	struct Chunk
+	{
+		uint64_t packets = 0;
+		uint64_t sync_losses = 0;
+		std::vector<PATChange> changes;
+	};
+
+	static constexpr uint64_t CHUNK_SIZE = 64 * 1024 * 1024;
+
+	std::string path_;
+	uint32_t threads_ = 0;
+	uint64_t size_ = 0;
+	uint64_t packets_ = 0;
+	uint64_t sync_losses_ = 0;
+	std::vector<PATChange> timeline_;
+
+	static void analyze_chunk(const uint8_t* data, uint64_t size, uint64_t begin, uint64_t end, Chunk& chunk);
+};
+
+}
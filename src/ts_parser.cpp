@@ -0,0 +1,179 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "json.hpp"
+
+#include "trace.h"
+#include "ts_parser.h"
+
+namespace px4tsid
+{
+
+void to_json(nlohmann::json& j, const SlotStats& p)
+{
+	auto pids = nlohmann::json::array();
+	for (const auto& pid : p.pids)
+	{
+		pids.push_back({
+			{"pid", pid.pid},
+			{"packets", pid.packets},
+			{"cc_errors", pid.cc_errors},
+		});
+	}
+
+	j = nlohmann::json{
+		{"packets", p.packets},
+		{"transport_errors", p.transport_errors},
+		{"bitrate_bps", p.bitrate_bps},
+		{"pids", pids},
+	};
+}
+
+void from_json(const nlohmann::json& j, SlotStats& p)
+{
+	p.packets = j.at("packets");
+	p.transport_errors = j.at("transport_errors");
+	p.bitrate_bps = j.at("bitrate_bps");
+	p.pids.clear();
+	for (const auto& pid : j.at("pids"))
+	{
+		p.pids.push_back({ pid.at("pid"), pid.at("packets"), pid.at("cc_errors") });
+	}
+}
+
+void TSParser::set_stats(bool is_enable)
+{
+	counters_.clear();
+	if (is_enable)
+	{
+		counters_.resize(PID_SIZE);
+	}
+	clear();
+}
+
+void TSParser::clear()
+{
+	rest_size_ = 0;
+	std::fill(counters_.begin(), counters_.end(), PIDCounter{ 0, 0, -1 });
+	packets_ = 0;
+	transport_errors_ = 0;
+}
+
+bool TSParser::parse_pat(const uint8_t* p, uint16_t& tsid, uint8_t& version)
+{
+	bool payload_start_indicator = (p[1] & 0x40) ? true : false;
+	uint16_t pid = ((p[1] & 0x1f) << 8) | p[2];
+	bool adaptation_field_control = (p[3] & 0x20) ? true : false;
+	uint8_t pointer_field = p[4];
+	if (payload_start_indicator && pid == 0 && !adaptation_field_control && pointer_field == 0)
+	{
+		tsid = (p[8] << 8) | p[9];
+		version = (p[10] >> 1) & 0x1f;
+		return true;
+	}
+	return false;
+}
+
+SlotStats TSParser::stats(std::chrono::microseconds elapsed) const
+{
+	SlotStats stats;
+	stats.packets = packets_;
+	stats.transport_errors = transport_errors_;
+	if (elapsed.count() > 0)
+	{
+		stats.bitrate_bps = packets_ * 188 * 8 * 1000000 / elapsed.count();
+	}
+
+	for (size_t pid = 0; pid < counters_.size(); pid++)
+	{
+		const auto& c = counters_.at(pid);
+		if (c.packets == 0) continue;
+		stats.pids.push_back({ static_cast<uint16_t>(pid), c.packets, c.cc_errors });
+	}
+
+	return stats;
+}
+
+int32_t TSParser::get_transport_stream_id(const uint8_t* buf, size_t size, uint16_t& tsid)
+{
+	int32_t error_counter = 0;
+	tsid = 0xffff;
+
+	// the stream is rest_ followed by buf, only a packet across the two is copied to put it in one piece
+	auto total = rest_size_ + size;
+	size_t pos = 0;
+	uint8_t joined[189];
+
+	while (total - pos > 188)
+	{
+		const uint8_t* p = joined;
+		if (pos < rest_size_)
+		{
+			auto head = rest_size_ - pos;
+			std::memcpy(joined, rest_.data() + pos, head);
+			std::memcpy(joined + head, buf, sizeof(joined) - head);
+		}
+		else
+		{
+			p = buf + (pos - rest_size_);
+		}
+		if (!((p[0] == 0x47) && (p[188] == 0x47)))
+		{
+			pos++;
+			continue;
+		}
+
+		bool transport_error_indicator = (p[1] & 0x80) ? true : false;
+		uint16_t pid = ((p[1] & 0x1f) << 8) | p[2];
+		uint8_t version;
+		if (transport_error_indicator)
+		{
+			error_counter++;
+		}
+		else if (parse_pat(p, tsid, version))
+		{
+			PX4TSID_TRACE(pat__found, tsid);
+		}
+
+		if (!counters_.empty())
+		{
+			auto& c = counters_[pid];
+			bool has_payload = (p[3] & 0x10) ? true : false;
+			int16_t cc = p[3] & 0x0f;
+			c.packets++;
+			if (!transport_error_indicator && has_payload && pid != 0x1fff)
+			{
+				// a single duplicate packet keeps the same counter
+				if (c.last_cc >= 0 && cc != c.last_cc && cc != ((c.last_cc + 1) & 0x0f))
+				{
+					c.cc_errors++;
+				}
+				c.last_cc = cc;
+			}
+		}
+		packets_++;
+		pos += 188;
+	}
+
+	transport_errors_ += error_counter;
+	// at most one packet is left over
+	if (pos < rest_size_)
+	{
+		std::memmove(rest_.data(), rest_.data() + pos, rest_size_ - pos);
+		std::memcpy(rest_.data() + rest_size_ - pos, buf, size);
+	}
+	else
+	{
+		std::memcpy(rest_.data(), buf + (pos - rest_size_), total - pos);
+	}
+	rest_size_ = total - pos;
+
+	return error_counter;
+}
+
+}
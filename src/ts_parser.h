@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <chrono>
+#include <vector>
+
+#include "json.hpp"
+
+namespace px4tsid
+{
+
+struct SlotStats
+{
+	struct PID
+	{
+		uint16_t pid;
+		uint64_t packets;
+		uint64_t cc_errors;
+	};
+
+	uint64_t packets = 0;
+	uint64_t transport_errors = 0;
+	uint64_t bitrate_bps = 0;
+	std::vector<PID> pids;
+};
+
+void to_json(nlohmann::json& j, const SlotStats& p);
+void from_json(const nlohmann::json& j, SlotStats& p);
+
+class TSParser
+{
+public:
+	TSParser() = default;
+	~TSParser() = default;
+
+	void set_stats(bool is_enable);
+	void clear();
+	int32_t get_transport_stream_id(const uint8_t* buf, size_t size, uint16_t& tsid);
+	SlotStats stats(std::chrono::microseconds elapsed) const;
+
+	static bool parse_pat(const uint8_t* p, uint16_t& tsid, uint8_t& version);
+
+private:
+	struct PIDCounter
+	{
+		uint64_t packets;
+		uint64_t cc_errors;
+		int16_t last_cc;
+	};
+
+	static constexpr size_t PID_SIZE = 8192;
+
+	std::array<uint8_t, 188> rest_;
+	size_t rest_size_ = 0;
+	std::vector<PIDCounter> counters_;
+	uint64_t packets_ = 0;
+	uint64_t transport_errors_ = 0;
+};
+
+}
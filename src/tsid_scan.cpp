@@ -1,50 +1,196 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
-#include <unistd.h>
-#include <signal.h>
-
 #include <cstdint>
 #include <cstring>
-#include <csignal>
-#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iomanip>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <sstream>
 #include <string>
-#include <thread>
 #include <vector>
 
 #include "json.hpp"
 
+#include "cancel_token.h"
+#include "capture_writer.h"
 #include "chset.h"
 #include "config.h"
+#include "dvb_device.h"
+#include "logger.h"
 #include "px4_device.h"
+#include "scan_plan.h"
+#include "scheduler.h"
+#include "task.h"
+#include "timing_profile.h"
+#include "trace.h"
+#include "ts_parser.h"
 #include "tsid_scan.h"
+#include "tuner.h"
 
 namespace px4tsid
 {
 
-volatile std::sig_atomic_t TSIDScan::has_stop_ = 0;
+namespace
+{
+
+// packets of the previous slot still in flight after a slot switch, one PAT interval
+constexpr std::chrono::milliseconds STALE_PAT_WINDOW{100};
+// answered slots needed before their p90 is trusted as the hedge delay
+constexpr size_t HEDGE_MIN_SAMPLES = 8;
+
+}
 
-void TSIDScan::init(int argc, char* argv[])
+std::unique_ptr<Tuner> make_tuner(const Config& config)
 {
-	config_.parse(argc, argv);
-	struct ::sigaction sa;
-	std::memset(&sa, 0, sizeof(sa));
-	sa.sa_handler = TSIDScan::signal_handler;
-	sa.sa_flags = SA_RESTART;
-	sigemptyset(&sa.sa_mask);
-	sigaction(SIGINT, &sa, nullptr);
-	sigaction(SIGTERM, &sa, nullptr);
-	sigaction(SIGPIPE, &sa, nullptr);
+	if (DVBDevice::is_dvb_device(config.device()))
+	{
+		auto tuner = std::make_unique<DVBDevice>();
+		tuner->set_delivery_system(config.delivery_system());
+		tuner->set_mapped_buffers(config.memory_budget_kb() == 0);
+		return tuner;
+	}
+	return std::make_unique<PX4Device>();
+}
+
+void to_json(nlohmann::json& j, const SlotResult& p)
+{
+	j = nlohmann::json{
+		{"band", p.band},
+		{"transponder", p.transponder},
+		{"number", p.number},
+		{"frequency_idx", p.frequency_idx},
+		{"frequency_khz", p.frequency_khz},
+		{"slot", p.slot},
+		{"transport_stream_id", p.transport_stream_id},
+		{"status", p.status},
+		{"elapsed_ms", p.elapsed.count()},
+		{"stats", p.stats == nullptr ? nlohmann::json() : nlohmann::json(*p.stats)},
+	};
+}
+
+void TSIDScan::init(const Config& config)
+{
+	config_ = config;
+	if (config_.plan().empty())
+	{
+		plan_.set_default(config_.ts_number_size());
+	}
+	else
+	{
+		plan_.load(config_.plan());
+	}
+	if (!config_.profile().empty())
+	{
+		profile_.load(config_.profile());
+	}
 }
 
 void TSIDScan::scan()
 {
+	CancelToken never;
+	scan(SlotCallback(), never);
+}
+
+void TSIDScan::scan(const SlotCallback& callback, const CancelToken& cancel)
+{
+	callback_ = callback;
+	cancel_ = &cancel;
+	if (!tuner_factory_)
+	{
+		tuner_factory_ = [this] { return make_tuner(config_); };
+	}
 	chsets_bs_.clear();
 	chsets_cs_.clear();
-	px4_device_.open_tuner(config_.device());
-	scan_tsid_bs();
-	scan_tsid_cs();
-	px4_device_.close_tuner();
+	scan_deadline_ = Tuner::clock::time_point::max();
+	if (config_.scan_timeout().count() > 0)
+	{
+		scan_deadline_ = Tuner::clock::now() + config_.scan_timeout();
+	}
+	if (config_.time_budget().count() > 0)
+	{
+		scan_deadline_ = std::min(scan_deadline_, Tuner::clock::now() + config_.time_budget());
+	}
+	is_pat_only_ = !config_.is_stats() && config_.capture_dir().empty();
+	tuner_pool_.set_devices(config_.devices());
+	tuner_pool_.set_busy_wait(config_.busy_wait());
+	tuner_pool_.set_max_failures(config_.max_failures());
+
+	// the first tuner may wait for an idle device, the others are taken only when idle now
+	workers_.clear();
+	for (auto i = 0; i < config_.tuners(); i++)
+	{
+		auto worker = make_worker(i == 0);
+		if (!worker) { break; }
+		workers_.push_back(std::move(worker));
+	}
+
+	// only PAT is read, so two tuners on one slot do not fight over captures or stats
+	is_hedge_ = config_.is_hedge() && is_pat_only_ && workers_.size() > 1;
+	answer_times_.clear();
+	jobs_.clear();
+	next_job_ = 0;
+	const auto& device = workers_.front()->tuner->device();
+	if (config_.time_budget().count() > 0)
+	{
+		// the most useful partial map when the budget runs out before the plan
+		for (auto history : { SlotHistory::populated, SlotHistory::unknown, SlotHistory::empty })
+		{
+			add_jobs("BS", plan_.bs(), chsets_bs_, device, history);
+			add_jobs("CS", plan_.cs(), chsets_cs_, device, history);
+		}
+	}
+	else
+	{
+		add_jobs("BS", plan_.bs(), chsets_bs_, device);
+		add_jobs("CS", plan_.cs(), chsets_cs_, device);
+	}
+
+	Scheduler scheduler;
+	scheduler.set_cancel(cancel_);
+	scheduler_ = &scheduler;
+	for (auto& worker : workers_)
+	{
+		scheduler.spawn(run_worker(*worker));
+	}
+	try
+	{
+		scheduler.run();
+	}
+	catch (...)
+	{
+		scheduler_ = nullptr;
+		throw;
+	}
+	scheduler_ = nullptr;
+
+	// transponders left over when every tuner failed or the scan ran out of time
+	for (; next_job_ < jobs_.size() && !is_cancelled(); next_job_++)
+	{
+		const auto& job = jobs_.at(next_job_);
+		job.chset->set_transponder(job.entry->transponder());
+		job.chset->set_number(job.entry->number());
+		job.chset->set_frequency_idx(job.entry->frequency_idx());
+		job.chset->set_frequency_khz(job.entry->frequency_khz());
+	}
+
+	for (auto& worker : workers_)
+	{
+		worker->capture.reset();
+		if (worker->tuner->is_open())
+		{
+			tuner_pool_.release(*worker->tuner);
+		}
+	}
+	if (!config_.profile().empty())
+	{
+		profile_.save(config_.profile());
+	}
+	callback_ = nullptr;
+	cancel_ = nullptr;
 }
 
 nlohmann::json TSIDScan::json() const
@@ -66,188 +212,617 @@ nlohmann::json TSIDScan::json() const
 	return j;
 }
 
-void TSIDScan::scan_tsid_bs()
+void TSIDScan::write_json(std::ostream& os) const
 {
-	using namespace std::chrono_literals;
-	std::vector<uint8_t> buf(config_.buffer_size());
-
-	chsets_bs_.resize(config_.transponder_size_bs());
-	for (auto idx = 0; idx < chsets_bs_.size(); idx++)
-	{
-		if (TSIDScan::has_stop_) { break; }
-		auto& chset = chsets_bs_.at(idx);
-		auto tpnum = idx * 2 + 1;
-		auto fqidx = idx;
-		uint32_t freq = 11727480 + 38360 * idx;
-		std::ostringstream os1;
-		os1 << "BS" << tpnum;
-		chset.set_transponder(os1.str());
-		chset.set_number(tpnum);
-		chset.set_frequency_idx(fqidx);
-		chset.set_frequency_khz(freq);
-
-		try
-		{
-			for (auto tsnum = 0; tsnum < config_.ts_number_size(); tsnum++)
+	// same text as json().dump(4), one ChSet at a time
+	auto write_band = [&os](const char* band, const std::vector<ChSet>& chsets, bool is_last) {
+		os << "    \"" << band << "\": ";
+		if (chsets.empty())
+		{
+			os << "[]";
+		}
+		else
+		{
+			os << "[\n";
+			for (size_t i = 0; i < chsets.size(); i++)
 			{
-				if (TSIDScan::has_stop_) { break; }
-				rest_buf_.clear();
-				std::cerr << "BS" << std::setw(2) << std::setfill('0') << tpnum << "/TS" << tsnum
-					<< " : Frequency = " << chset.frequency_khz()
-					<< '(' << chset.frequency_if_khz() << ')';
-
-				px4_device_.set_channel_s(fqidx, tsnum);
-				px4_device_.start_streaming();
-				chset.has_lock(true);
-				std::cerr << " : locked";
-
-				for (auto retry = 0; retry < config_.retry_count(); retry++)
+				auto text = nlohmann::json(chsets.at(i)).dump(4);
+				os << "        ";
+				for (auto c : text)
 				{
-					if (TSIDScan::has_stop_) { break; }
-					auto size = px4_device_.read_stream(buf.data(), buf.size());
-					if (size <= 0)
-					{
-						std::this_thread::sleep_for(100ms);
-						continue;
-					}
-					uint16_t tsid = 0xffff;
-					get_transport_stream_id(buf.data(), size, tsid);
-					if (tsid != 0xffff && !config_.is_ignore_tsid(tsid))
+					os << c;
+					if (c == '\n')
 					{
-						chset.set_transport_stream_id(tsnum, tsid);
-						std::cerr << " : TSID = " << tsid;
-						break;
+						os << "        ";
 					}
 				}
-				std::cerr << '\n';
-				px4_device_.stop_streaming();
+				os << (i + 1 < chsets.size() ? ",\n" : "\n");
 			}
+			os << "    ]";
 		}
-		catch(const std::exception& e)
-		{
-			std::cerr << " : " << e.what() << '\n';
-			px4_device_.stop_streaming();
-		}
+		os << (is_last ? "\n" : ",\n");
+	};
+
+	os << "{\n";
+	write_band("BS", chsets_bs_, false);
+	write_band("CS", chsets_cs_, true);
+	os << "}";
+}
+
+std::unique_ptr<TSIDScan::Worker> TSIDScan::make_worker(bool is_first)
+{
+	auto worker = std::make_unique<Worker>();
+	worker->tuner = tuner_factory_();
+	worker->tuner->set_lnb_power(config_.lnb_power());
+	worker->tuner->set_timeout(config_.io_timeout());
+	worker->tuner->set_deadline(scan_deadline_);
+	worker->tuner->set_pat_only(is_pat_only_);
+	worker->tuner->set_cancel(&worker->lost);
+	if (is_first)
+	{
+		tuner_pool_.acquire(*worker->tuner, cancel_);
+	}
+	else if (!tuner_pool_.try_acquire(*worker->tuner))
+	{
+		return nullptr;
 	}
+	PX4TSID_LOG(LogLevel::info, "use %s", worker->tuner->device().c_str());
 
-	px4_device_.stop_streaming();
-	if (TSIDScan::has_stop_)
+	worker->ts_parser.set_stats(config_.is_stats());
+	worker->buf.resize(config_.buffer_size());
+	if (!config_.capture_dir().empty())
 	{
-		throw std::runtime_error("catch signal");
+		worker->capture = std::make_unique<CaptureWriter>(config_.buffer_size());
 	}
+	return worker;
 }
 
-void TSIDScan::scan_tsid_cs()
+void TSIDScan::set_history(const nlohmann::json& table)
 {
-	using namespace std::chrono_literals;
-	std::vector<uint8_t> buf(config_.buffer_size());
-
-	chsets_cs_.resize(config_.transponder_size_bs());
-	for (size_t idx = 0; idx < chsets_cs_.size(); idx++)
-	{
-		if (TSIDScan::has_stop_) { break; }
-		auto& chset = chsets_cs_.at(idx);
-		auto tpnum = (idx + 1) * 2;
-		auto fqidx = idx + config_.transponder_size_bs();
-		uint32_t freq = 12291000 + 40000 * idx;
-		std::ostringstream os1;
-		os1 << "ND" << tpnum;
-		chset.set_transponder(os1.str());
-		chset.set_number(tpnum);
-		chset.set_frequency_idx(fqidx);
-		chset.set_frequency_khz(freq);
-
-		auto tsnum = 0;
-		rest_buf_.clear();
-		std::cerr << "ND" << std::setw(2) << std::setfill('0') << tpnum
-			<< " : Frequency = " << chset.frequency_khz()
-			<< '(' << chset.frequency_if_khz() << ')';
-		try
-		{
-			px4_device_.set_channel_s(fqidx, tsnum);
-			px4_device_.start_streaming();
-			chset.has_lock(true);
-			std::cerr << " : locked";
-
-			for (auto retry = 0; retry < config_.retry_count(); retry++)
+	history_.clear();
+	for (const auto& band : { "BS", "CS" })
+	{
+		if (!table.contains(band))
+		{
+			continue;
+		}
+		for (const auto& c : table.at(band).get<std::vector<ChSet>>())
+		{
+			for (size_t slot = 0; slot < c.transport_stream_id().size(); slot++)
 			{
-				if (TSIDScan::has_stop_) { break; }
-				auto size = px4_device_.read_stream(buf.data(), buf.size());
-				if (size <= 0)
+				auto status = slot < c.slot_status().size() ? c.slot_status(slot) : SlotStatus::found;
+				if (c.transport_stream_id(slot) != 0xffff)
 				{
-					std::this_thread::sleep_for(100ms);
-					continue;
+					history_[{ c.frequency_idx(), slot }] = true;
 				}
-				uint16_t tsid = 0xffff;
-				get_transport_stream_id(buf.data(), size, tsid);
-				if (tsid != 0xffff && !config_.is_ignore_tsid(tsid))
+				else if (status != SlotStatus::unprobed && status != SlotStatus::error)
 				{
-					chset.set_transport_stream_id(tsnum, tsid);
-					std::cerr << " : TSID = " << tsid;
-					break;
+					history_[{ c.frequency_idx(), slot }] = false;
 				}
 			}
-			std::cerr << '\n';
-			px4_device_.stop_streaming();
 		}
-		catch(const std::exception& e)
+	}
+}
+
+bool TSIDScan::is_complete() const
+{
+	for (const auto& job : jobs_)
+	{
+		for (auto tsnum : job.slots)
+		{
+			if (job.chset->slot_status(tsnum) == SlotStatus::unprobed)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void TSIDScan::add_jobs(const std::string& band, const std::vector<PlanEntry>& plan, std::vector<ChSet>& chsets, const std::string& device,
+	std::optional<SlotHistory> history)
+{
+	chsets.resize(plan.size());
+	for (auto idx : scan_order(plan, device))
+	{
+		const auto& entry = plan.at(idx);
+		std::vector<int32_t> slots;
+		for (auto tsnum : entry.slots())
+		{
+			if (!history || slot_history(device, entry.frequency_idx(), tsnum) == *history)
+			{
+				slots.push_back(tsnum);
+			}
+		}
+		if (!slots.empty())
+		{
+			jobs_.push_back({ band, &entry, &chsets.at(idx), slots, history == SlotHistory::empty });
+		}
+	}
+}
+
+TSIDScan::SlotHistory TSIDScan::slot_history(const std::string& device, int32_t frequency_idx, int32_t slot) const
+{
+	auto it = history_.find({ frequency_idx, slot });
+	if (profile_.is_expected(device, frequency_idx, slot) || (it != history_.end() && it->second))
+	{
+		return SlotHistory::populated;
+	}
+	auto entry = profile_.find(device, frequency_idx, slot);
+	if ((it != history_.end() && !it->second) || (entry != nullptr && entry->samples > 0 && entry->successes == 0))
+	{
+		return SlotHistory::empty;
+	}
+	return SlotHistory::unknown;
+}
+
+Task<void> TSIDScan::run_worker(Worker& worker)
+{
+	while (!is_cancelled() && worker.tuner->is_open() && Tuner::clock::now() < scan_deadline_)
+	{
+		if (next_job_ < jobs_.size())
+		{
+			const auto& job = jobs_.at(next_job_++);
+			co_await scan_transponder(worker, job);
+			continue;
+		}
+		if (!is_hedge_)
+		{
+			break;
+		}
+
+		// nothing left to start, race the slots of the other tuners that run late
+		worker.slot_changed.reset();
+		std::optional<Tuner::clock::time_point> wake;
+		auto owner = hedge_candidate(worker, wake);
+		if (owner != nullptr)
+		{
+			co_await hedge_slot(worker, *owner);
+		}
+		else if (wake)
+		{
+			co_await scheduler_->sleep_until(*wake, &worker.slot_changed);
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if (worker.tuner->is_open())
+	{
+		worker.tuner->set_deadline(Tuner::clock::time_point::max());
+		co_await scheduler_->blocking(worker.helper, [&] { worker.tuner->stop_streaming(); });
+	}
+}
+
+Task<void> TSIDScan::scan_transponder(Worker& worker, const Job& job)
+{
+	const auto& entry = *job.entry;
+	auto& chset = *job.chset;
+	auto& tuner = *worker.tuner;
+	chset.set_transponder(entry.transponder());
+	chset.set_number(entry.number());
+	chset.set_frequency_idx(entry.frequency_idx());
+	chset.set_frequency_khz(entry.frequency_khz());
+	auto slot_timeout = entry.timeout_ms() > 0 ? std::chrono::milliseconds(entry.timeout_ms()) : config_.slot_timeout();
+	worker.job = &job;
+
+	auto has_response = false;
+	for (auto tsnum : job.slots)
+	{
+		if (is_cancelled() || !tuner.is_open() || Tuner::clock::now() >= scan_deadline_) { break; }
+		auto start = Tuner::clock::now();
+		auto timeout = profile_.deadline(tuner.device(), entry.frequency_idx(), tsnum, slot_timeout);
+		auto is_expected = profile_.is_expected(tuner.device(), entry.frequency_idx(), tsnum);
+		worker.tsnum = tsnum;
+		worker.slot_start = start;
+		worker.slot_deadline = std::min(start + timeout, scan_deadline_);
+		notify_slot_changed();
+		auto status = co_await scan_slot(worker, entry, tsnum, timeout, chset);
+		if (status == SlotStatus::timeout && timeout < slot_timeout && is_expected && tuner.is_open())
+		{
+			// slower than usual, give it the full budget once
+			worker.slot_deadline = std::min(Tuner::clock::now() + slot_timeout, scan_deadline_);
+			status = co_await scan_slot(worker, entry, tsnum, slot_timeout, chset);
+		}
+		status = finish_slot(worker, status);
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(Tuner::clock::now() - start);
+		if (status == SlotStatus::found || status == SlotStatus::not_found)
 		{
-			std::cerr << " : " << e.what() << '\n';
-			px4_device_.stop_streaming();
+			answer_times_.push_back(elapsed);
 		}
+		chset.set_slot_status(tsnum, status);
+		SlotResult result = {
+			job.band,
+			chset.transponder(),
+			chset.number(),
+			chset.frequency_idx(),
+			chset.frequency_khz(),
+			tsnum,
+			chset.transport_stream_id(tsnum),
+			status,
+			elapsed,
+			chset.slot_stats().empty() ? nullptr : &chset.slot_stats().at(tsnum),
+		};
+		if (callback_)
+		{
+			callback_(result);
+		}
+		if (handoff_ && status == SlotStatus::found && tuner.is_open() && handoff_(result, tuner))
+		{
+			// the receiver records from this tuner now
+			PX4TSID_LOG(LogLevel::info, "%s : handed off", tuner.device().c_str());
+			tuner.detach();
+			break;
+		}
+		has_response = has_response || status != SlotStatus::timeout;
+		if (status == SlotStatus::error) { break; }
+	}
+	worker.job = nullptr;
+	notify_slot_changed();
+
+	if (tuner.is_open())
+	{
+		tuner.set_deadline(Tuner::clock::time_point::max());
+		co_await scheduler_->blocking(worker.helper, [&] { tuner.stop_streaming(); });
 	}
 
-	px4_device_.stop_streaming();
-	if (TSIDScan::has_stop_)
+	// a tuner timing out on every slot of several transponders in a row is wedged
+	if (!job.is_known_empty)
 	{
-		throw std::runtime_error("catch signal");
+		worker.timeout_count = has_response ? 0 : worker.timeout_count + 1;
+	}
+	if (worker.timeout_count >= config_.max_failures() && tuner.is_open())
+	{
+		co_await switch_tuner(worker);
 	}
 }
 
-int32_t TSIDScan::get_transport_stream_id(const uint8_t* buf, size_t size, uint16_t& tsid)
+Task<void> TSIDScan::switch_tuner(Worker& worker)
 {
-	int32_t error_counter = 0;
-	tsid = 0xffff;
+	auto& tuner = *worker.tuner;
+	PX4TSID_LOG(LogLevel::warn, "%s : %d transponders timed out in a row", tuner.device().c_str(), worker.timeout_count);
+	worker.timeout_count = 0;
+	worker.stream_tsid = 0xffff;
+	try
+	{
+		co_await scheduler_->blocking(worker.helper, [&] {
+			tuner_pool_.release(tuner, true);
+			tuner.set_deadline(scan_deadline_);
+			tuner_pool_.acquire(tuner, cancel_);
+		});
+		PX4TSID_LOG(LogLevel::info, "use %s", tuner.device().c_str());
+	}
+	catch (const std::exception& e)
+	{
+		PX4TSID_LOG(LogLevel::error, "%s", e.what());
+	}
+}
 
-	auto rest_size = rest_buf_.size();
-	rest_buf_.resize(rest_size + size);
-	std::memcpy(rest_buf_.data() + rest_size, buf, size);
+Task<void> TSIDScan::hedge_slot(Worker& worker, Worker& owner)
+{
+	const auto& job = *owner.job;
+	auto tsnum = owner.tsnum;
+	owner.is_hedged = true;
+	owner.hedge = &worker;
+	PX4TSID_LOG(LogLevel::info, "%s/TS%d : late on %s, race it on %s", job.chset->transponder().c_str(), tsnum,
+		owner.tuner->device().c_str(), worker.tuner->device().c_str());
 
-	auto p = rest_buf_.data();
-	auto tail = p + rest_buf_.size();
+	auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(owner.slot_deadline - Tuner::clock::now());
+	auto status = co_await scan_slot(worker, *job.entry, tsnum, timeout, *job.chset);
 
-	while (p < tail - 188)
+	// the owner cancels this worker when it finishes first, otherwise it is still on the slot
+	if (!worker.lost.is_cancelled())
 	{
-		if (!((p[0] == 0x47) && (p[188] == 0x47)))
+		if (status == SlotStatus::found || status == SlotStatus::not_found)
+		{
+			owner.hedge_status = status;
+			owner.lost.cancel();
+		}
+		owner.hedge = nullptr;
+	}
+	worker.lost.reset();
+}
+
+TSIDScan::Worker* TSIDScan::hedge_candidate(const Worker& worker, std::optional<Tuner::clock::time_point>& wake) const
+{
+	auto now = Tuner::clock::now();
+	auto delay = hedge_delay();
+	Worker* candidate = nullptr;
+	for (const auto& w : workers_)
+	{
+		if (w.get() == &worker || w->job == nullptr)
+		{
+			continue;
+		}
+		// wait for the slot to change at the latest
+		if (!wake)
+		{
+			wake = Tuner::clock::time_point::max();
+		}
+		if (w->tsnum == -1 || w->is_hedged || !delay || now >= w->slot_deadline)
 		{
-			p++;
 			continue;
 		}
+		auto late = w->slot_start + *delay;
+		if (late > now)
+		{
+			wake = std::min(*wake, late);
+			continue;
+		}
+		if (candidate == nullptr || w->slot_start < candidate->slot_start)
+		{
+			candidate = w.get();
+		}
+	}
+	return candidate;
+}
+
+std::optional<std::chrono::milliseconds> TSIDScan::hedge_delay() const
+{
+	if (answer_times_.size() < HEDGE_MIN_SAMPLES)
+	{
+		return std::nullopt;
+	}
+	auto times = answer_times_;
+	auto p90 = times.begin() + times.size() * 9 / 10;
+	std::nth_element(times.begin(), p90, times.end());
+	return *p90;
+}
+
+SlotStatus TSIDScan::finish_slot(Worker& worker, SlotStatus status)
+{
+	if (worker.hedge_status)
+	{
+		// the hedge answered first
+		status = *worker.hedge_status;
+	}
+	else if (worker.hedge != nullptr)
+	{
+		worker.hedge->lost.cancel();
+	}
+	worker.tsnum = -1;
+	worker.is_hedged = false;
+	worker.hedge = nullptr;
+	worker.hedge_status.reset();
+	worker.lost.reset();
+	notify_slot_changed();
+	return status;
+}
+
+void TSIDScan::notify_slot_changed()
+{
+	if (!is_hedge_)
+	{
+		return;
+	}
+	for (auto& w : workers_)
+	{
+		w->slot_changed.cancel();
+	}
+}
+
+std::vector<size_t> TSIDScan::scan_order(const std::vector<PlanEntry>& plan, const std::string& device) const
+{
+	std::vector<size_t> order(plan.size());
+	for (size_t idx = 0; idx < order.size(); idx++)
+	{
+		order.at(idx) = idx;
+	}
+
+	// transponders that usually answer first, so failover and deadlines hit the flaky ones last
+	if (!profile_.empty())
+	{
+		std::vector<double> rates;
+		for (const auto& entry : plan)
+		{
+			rates.push_back(profile_.failure_rate(device, entry.frequency_idx()));
+		}
+		std::stable_sort(order.begin(), order.end(), [&rates](size_t a, size_t b) { return rates.at(a) < rates.at(b); });
+	}
+
+	return order;
+}
+
+// a capture buffer to read into, the worker's own buffer when the writer fell behind,
+// since waiting for the writer would stall every tuner on the scheduler
+uint8_t* TSIDScan::acquire_capture(Worker& worker) const
+{
+	auto buf = worker.capture->acquire();
+	return buf != nullptr ? buf : worker.buf.data();
+}
+
+Task<SlotStatus> TSIDScan::scan_slot(Worker& worker, const PlanEntry& entry, int32_t tsnum, std::chrono::milliseconds slot_timeout, ChSet& chset)
+{
+	using namespace std::chrono_literals;
+	auto& tuner = *worker.tuner;
+	auto& ts_parser = worker.ts_parser;
+	auto& capture = worker.capture;
+	auto retry_count = (entry.retry_count() > 0 ? entry.retry_count() : config_.retry_count()) * config_.reads_per_retry();
+	auto status = SlotStatus::not_found;
+	auto has_pat = false;
+	auto is_locked = false;
+	uint16_t pat_tsid = 0xffff;
+	std::string error;
+	auto tune_start = Tuner::clock::now();
+	auto stream_start = tune_start;
+	auto stream_end = stream_start;
+	auto last_read = stream_start;
+	auto stats_end = Tuner::clock::time_point::max();
+	// with PAT only there is nothing to keep apart, so the stream runs across the slots of a transponder
+	uint16_t stale_tsid = is_pat_only_ && tuner.has_straming() ? worker.stream_tsid : 0xffff;
+
+	PX4TSID_TRACE(slot__start, entry.frequency_idx(), tsnum);
+	auto slot_deadline = std::min(Tuner::clock::now() + slot_timeout, scan_deadline_);
+	tuner.set_deadline(slot_deadline);
+	ts_parser.clear();
+
+	auto data = worker.buf.data();
+	if (capture)
+	{
+		std::ostringstream os;
+		os << config_.capture_dir() << '/' << chset.transponder() << "_TS" << tsnum << ".ts";
+		capture->open(os.str(), config_.capture_size());
+		data = acquire_capture(worker);
+	}
+
+	try
+	{
+		co_await scheduler_->blocking(worker.helper, [&] {
+			tuner.set_channel_s(entry.frequency_idx(), tsnum);
+			tuner.start_streaming();
+		});
+		chset.has_lock(true);
+		is_locked = true;
+		stream_start = Tuner::clock::now();
+		stream_end = stream_start;
+		last_read = stream_start;
+
+		// past its PAT a slot is read only to fill the --stats window
+		for (auto retry = 0; retry < retry_count || has_pat; retry++)
+		{
+			if (is_cancelled(worker) || Tuner::clock::now() >= stats_end) { break; }
+			ssize_t size = 0;
+			const uint8_t* chunk = data;
+			auto fd = tuner.poll_fd();
+			if (fd != -1)
+			{
+				auto read_deadline = std::min({ Tuner::clock::now() + config_.io_timeout(), slot_deadline, stats_end });
+				if (!co_await scheduler_->readable(fd, read_deadline, &worker.lost))
+				{
+					if (is_cancelled(worker) || has_pat) { break; }
+					PX4TSID_TRACE(read__timeout);
+					throw TimeoutError("read timed out");
+				}
+				// parsed in place in the driver's buffer unless it has to be kept for the capture
+				size = !capture && tuner.has_stream_view() ? tuner.view_stream(chunk) : tuner.read_stream(data, worker.buf.size());
+			}
+			else
+			{
+				size = co_await scheduler_->blocking(worker.helper, [&] { return tuner.read_stream(data, worker.buf.size()); });
+			}
+			if (size <= 0)
+			{
+				co_await scheduler_->sleep_for(100ms);
+				continue;
+			}
+			uint16_t tsid = 0xffff;
+			ts_parser.get_transport_stream_id(chunk, size, tsid);
+			if (chunk != data)
+			{
+				tuner.release_stream();
+			}
+			last_read = Tuner::clock::now();
+			if (capture)
+			{
+				if (data != worker.buf.data())
+				{
+					capture->submit(data, size);
+				}
+				else
+				{
+					capture->skip(size);
+				}
+				data = acquire_capture(worker);
+			}
+			if (has_pat)
+			{
+				continue;
+			}
+			stream_end = last_read;
+			if (tsid != 0xffff && tsid == stale_tsid && stream_end - stream_start < STALE_PAT_WINDOW)
+			{
+				// still the previous slot, wait for the PAT to change
+				retry--;
+				continue;
+			}
+			if (tsid != 0xffff)
+			{
+				worker.stream_tsid = tsid;
+			}
+			if (tsid != 0xffff && !config_.is_ignore_tsid(tsid))
+			{
+				has_pat = true;
+				chset.set_transport_stream_id(tsnum, tsid);
+				if (chset.transport_stream_id(tsnum) == tsid)
+				{
+					status = SlotStatus::found;
+				}
+				pat_tsid = tsid;
+				if (!config_.is_stats())
+				{
+					break;
+				}
+				// stats of the reads up to the PAT would cover a few tens of ms, measure a fixed window instead
+				stats_end = std::min(stream_start + config_.stats_window(), slot_deadline);
+				tuner.set_deadline(stats_end);
+			}
+		}
+	}
+	catch (const TimeoutError& e)
+	{
+		// the end of the --stats window, the slot itself is done
+		if (!has_pat)
+		{
+			error = e.what();
+			// cut short by the scan budget rather than given up on, nothing is known about the slot
+			status = slot_deadline == scan_deadline_ && Tuner::clock::now() >= scan_deadline_ ? SlotStatus::unprobed : SlotStatus::timeout;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		error = e.what();
+		status = SlotStatus::error;
+	}
 
-		bool transport_error_indicator = (p[1] & 0x80) ? true : false;
-		bool payload_start_indicator = (p[1] & 0x40) ? true : false;
-		uint16_t pid = ((p[1] & 0x1f) << 8) | p[2];
-		bool adaptation_field_control = (p[3] & 0x20) ? true : false;
-		uint8_t pointer_field = p[4];
-		if (transport_error_indicator)
+	if (logger().is_enabled(LogLevel::info))
+	{
+		char tsid_text[32] = "";
+		if (pat_tsid != 0xffff)
 		{
-			error_counter++;
+			std::snprintf(tsid_text, sizeof(tsid_text), " : TSID = %u", pat_tsid);
 		}
-		else if (payload_start_indicator && pid == 0 && !adaptation_field_control && pointer_field == 0)
+		logger().log(LogLevel::info, "%s/TS%d : Frequency = %u(%u)%s%s%s%s",
+			chset.transponder().c_str(), tsnum, chset.frequency_khz(), chset.frequency_if_khz(),
+			is_locked ? " : locked" : "", tsid_text, error.empty() ? "" : " : ", error.c_str());
+	}
+
+	if (capture)
+	{
+		if (data != worker.buf.data())
 		{
-			tsid = (p[8] << 8) | p[9];
+			capture->release(data);
 		}
-		p += 188;
+		capture->close();
+	}
+
+	if (is_cancelled(worker) && status != SlotStatus::found)
+	{
+		status = SlotStatus::unprobed;
+	}
+
+	if (!config_.profile().empty() && status != SlotStatus::unprobed)
+	{
+		using std::chrono::duration_cast;
+		using std::chrono::milliseconds;
+		profile_.update(tuner.device(), entry.frequency_idx(), tsnum, has_pat,
+			duration_cast<milliseconds>(stream_start - tune_start), duration_cast<milliseconds>(stream_end - stream_start));
 	}
 
-	rest_size = tail - p;
-	if (rest_size > 0)
+	if (config_.is_stats())
 	{
-		std::memmove(rest_buf_.data(), p, rest_size);
-		rest_buf_.resize(rest_size);
+		// a window read to its end counts in full, however long the stream went quiet
+		auto stats_time = has_pat ? std::min(Tuner::clock::now(), stats_end) : last_read;
+		chset.set_slot_stats(tsnum, ts_parser.stats(std::chrono::duration_cast<std::chrono::microseconds>(stats_time - stream_start)));
 	}
 
-	return error_counter;
+	if (!is_pat_only_ || (status != SlotStatus::found && status != SlotStatus::not_found))
+	{
+		co_await scheduler_->blocking(worker.helper, [&] { tuner.stop_streaming(); });
+	}
+	PX4TSID_TRACE(slot__done, entry.frequency_idx(), tsnum, static_cast<int>(status), chset.transport_stream_id(tsnum));
+	co_return status;
 }
 
-}
\ No newline at end of file
+}
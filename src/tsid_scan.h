@@ -3,42 +3,162 @@
 #pragma once
 
 #include <cstdint>
-#include <csignal>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "json.hpp"
 
+#include "cancel_token.h"
+#include "capture_writer.h"
 #include "chset.h"
 #include "config.h"
-#include "px4_device.h"
+#include "scan_plan.h"
+#include "scheduler.h"
+#include "task.h"
+#include "timing_profile.h"
+#include "ts_parser.h"
+#include "tuner.h"
+#include "tuner_pool.h"
 
 namespace px4tsid
 {
 
+struct SlotResult
+{
+	std::string band;
+	std::string transponder;
+	int32_t number;
+	int32_t frequency_idx;
+	uint32_t frequency_khz;
+	int32_t slot;
+	uint16_t transport_stream_id;
+	SlotStatus status;
+	std::chrono::milliseconds elapsed;
+	const SlotStats* stats;
+};
+
+void to_json(nlohmann::json& j, const SlotResult& p);
+
+using SlotCallback = std::function<void(const SlotResult&)>;
+using TunerFactory = std::function<std::unique_ptr<Tuner>()>;
+// the default TunerFactory, DVBDevice for a /dev/dvb/ adapter and PX4Device otherwise
+std::unique_ptr<Tuner> make_tuner(const Config& config);
+// called with the tuner still streaming a found slot, true when it was passed on and must not be stopped
+using HandoffCallback = std::function<bool(const SlotResult&, Tuner&)>;
+
 class TSIDScan
 {
 public:
 	TSIDScan() = default;
 	~TSIDScan() = default;
 
-	static void signal_handler(int signum) { TSIDScan::has_stop_ = 1; }
-	void init(int argc, char* argv[]);
+	void init(const Config& config);
+	void set_plan(const ScanPlan& plan) { plan_ = plan; }
+	void set_tuner_factory(const TunerFactory& factory) { tuner_factory_ = factory; }
+	void set_handoff(const HandoffCallback& handoff) { handoff_ = handoff; }
+	// table of the last scan, orders the slots for --time-budget
+	void set_history(const nlohmann::json& table);
 	void scan();
+	void scan(const SlotCallback& callback, const CancelToken& cancel);
+	const std::vector<ChSet>& chsets_bs() const { return chsets_bs_; }
+	const std::vector<ChSet>& chsets_cs() const { return chsets_cs_; }
 	nlohmann::json json() const;
+	// streams the result without building json() first
+	void write_json(std::ostream& os) const;
+	// every planned slot was probed, false when the scan ran out of time or was cancelled
+	bool is_complete() const;
 	std::string format() const { return config_.format(); }
 
 private:
-	static volatile std::sig_atomic_t has_stop_;
+	// what the last scan and the profile say about a slot, --time-budget scans them in this order
+	enum class SlotHistory
+	{
+		populated,
+		unknown,
+		empty,
+	};
+
+	struct Job
+	{
+		std::string band;
+		const PlanEntry* entry;
+		ChSet* chset;
+		std::vector<int32_t> slots;
+		// slots that were empty last time, timing out there says nothing about the tuner
+		bool is_known_empty = false;
+	};
+
+	// state of one tuner, every tuner runs its own task on the scheduler
+	struct Worker
+	{
+		std::unique_ptr<Tuner> tuner;
+		// runs the tuner calls that block, started once per worker
+		HelperThread helper;
+		TSParser ts_parser;
+		std::vector<uint8_t> buf;
+		std::unique_ptr<CaptureWriter> capture;
+		int32_t timeout_count = 0;
+		uint16_t stream_tsid = 0xffff;
+
+		// slot in flight, with --hedge an idle worker scans it too once it runs late
+		const Job* job = nullptr;
+		int32_t tsnum = -1;
+		Tuner::clock::time_point slot_start;
+		Tuner::clock::time_point slot_deadline;
+		bool is_hedged = false;
+		Worker* hedge = nullptr;
+		std::optional<SlotStatus> hedge_status;
+		// the other tuner answered the slot first, also aborts the tuner operation in progress
+		CancelToken lost;
+		// a slot of another worker started or finished while this one waits to hedge
+		CancelToken slot_changed;
+	};
+
 	Config config_;
-	PX4Device px4_device_;
+	ScanPlan plan_;
+	TunerFactory tuner_factory_;
+	TunerPool tuner_pool_;
+	TimingProfile profile_;
+	std::map<std::pair<int32_t, int32_t>, bool> history_;
+	Scheduler* scheduler_ = nullptr;
+	Tuner::clock::time_point scan_deadline_ = Tuner::clock::time_point::max();
+	SlotCallback callback_;
+	HandoffCallback handoff_;
+	const CancelToken* cancel_ = nullptr;
+	bool is_pat_only_ = true;
+	bool is_hedge_ = false;
+	std::vector<std::unique_ptr<Worker>> workers_;
+	std::vector<Job> jobs_;
+	size_t next_job_ = 0;
+	std::vector<std::chrono::milliseconds> answer_times_;
 
-	std::vector<uint8_t> rest_buf_;
 	std::vector<ChSet> chsets_bs_;
 	std::vector<ChSet> chsets_cs_;
 
-	void scan_tsid_bs();
-	void scan_tsid_cs();
-	int32_t get_transport_stream_id(const uint8_t* buf, size_t size, uint16_t& tsid);
+	bool is_cancelled() const { return cancel_ != nullptr && cancel_->is_cancelled(); }
+	bool is_cancelled(const Worker& worker) const { return is_cancelled() || worker.lost.is_cancelled(); }
+	std::unique_ptr<Worker> make_worker(bool is_first);
+	void add_jobs(const std::string& band, const std::vector<PlanEntry>& plan, std::vector<ChSet>& chsets, const std::string& device,
+		std::optional<SlotHistory> history = std::nullopt);
+	SlotHistory slot_history(const std::string& device, int32_t frequency_idx, int32_t slot) const;
+	Task<void> run_worker(Worker& worker);
+	Task<void> scan_transponder(Worker& worker, const Job& job);
+	Task<void> switch_tuner(Worker& worker);
+	Task<void> hedge_slot(Worker& worker, Worker& owner);
+	Worker* hedge_candidate(const Worker& worker, std::optional<Tuner::clock::time_point>& wake) const;
+	std::optional<std::chrono::milliseconds> hedge_delay() const;
+	SlotStatus finish_slot(Worker& worker, SlotStatus status);
+	void notify_slot_changed();
+	std::vector<size_t> scan_order(const std::vector<PlanEntry>& plan, const std::string& device) const;
+	uint8_t* acquire_capture(Worker& worker) const;
+	Task<SlotStatus> scan_slot(Worker& worker, const PlanEntry& entry, int32_t tsnum, std::chrono::milliseconds slot_timeout, ChSet& chset);
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+#include "cancel_token.h"
+#include "tuner.h"
+
+namespace px4tsid
+{
+
+std::chrono::milliseconds Tuner::time_left(const std::string& op) const
+{
+	auto now = clock::now();
+	auto timeout = timeout_;
+	if (deadline_ != clock::time_point::max())
+	{
+		timeout = std::min(timeout, std::chrono::duration_cast<std::chrono::milliseconds>(deadline_ - now));
+	}
+
+	if (timeout.count() <= 0)
+	{
+		throw TimeoutError(op + " timed out");
+	}
+	if (cancel_ != nullptr && cancel_->is_cancelled())
+	{
+		throw TimeoutError(op + " cancelled");
+	}
+
+	return timeout;
+}
+
+}
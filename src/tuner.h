@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+#include "cancel_token.h"
+
+namespace px4tsid
+{
+
+class TimeoutError : public std::runtime_error
+{
+public:
+	using std::runtime_error::runtime_error;
+};
+
+class BusyError : public std::runtime_error
+{
+public:
+	using std::runtime_error::runtime_error;
+};
+
+// Interface of an ISDB-S tuner. Every operation is bounded by the timeout
+// and the deadline, whichever comes first, and throws TimeoutError. A
+// cancelled token ends the operation the same way, as far as the driver
+// call in progress allows.
+class Tuner
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	Tuner() = default;
+	virtual ~Tuner() = default;
+
+	void set_timeout(std::chrono::milliseconds timeout) { timeout_ = timeout; }
+	void set_deadline(clock::time_point deadline) { deadline_ = deadline; }
+	void set_cancel(const CancelToken* cancel) { cancel_ = cancel; }
+
+	virtual void set_lnb_power(bool is_enable) = 0;
+	virtual bool has_straming() const = 0;
+	virtual const std::string& device() const = 0;
+	virtual bool is_open() const = 0;
+	virtual void open_tuner(const std::string& device) = 0;
+	virtual bool lock_tuner() = 0;
+	virtual void close_tuner() = 0;
+	virtual void set_channel_s(int32_t freq_num, int32_t slot_num) = 0;
+	// tunes any satellite frequency (before the LNB) for --sweep, a logic_error when the backend cannot
+	virtual void set_frequency_s(uint32_t frequency_khz, int32_t slot_num)
+	{
+		throw std::logic_error(device() + " : no frequency tuning");
+	}
+	virtual void start_streaming() = 0;
+	virtual void stop_streaming() = 0;
+	virtual ssize_t read_stream(uint8_t* buf, size_t size) = 0;
+	// read_stream() without the copy: data points into the driver's buffer, which stays valid
+	// until release_stream() or the next view_stream(), only when has_stream_view()
+	virtual bool has_stream_view() const { return false; }
+	virtual ssize_t view_stream(const uint8_t*& data) { throw std::logic_error(device() + " : no stream view"); }
+	virtual void release_stream() {}
+	// backends with a hardware demux may then deliver PID 0 only
+	virtual void set_pat_only(bool is_enable) {}
+	// readable when read_stream() has data, -1 when read_stream() has to block
+	virtual int32_t poll_fd() { return -1; }
+	// descriptor another process can go on reading the stream from, -1 when there is none
+	virtual int32_t handoff_fd() const { return -1; }
+	// closes the device without stopping the stream or the LNB power, which now belong
+	// to the process handoff_fd() was passed to
+	virtual void detach() { close_tuner(); }
+
+protected:
+	std::chrono::milliseconds timeout_{5000};
+	clock::time_point deadline_ = clock::time_point::max();
+	const CancelToken* cancel_ = nullptr;
+
+	std::chrono::milliseconds time_left(const std::string& op) const;
+};
+
+}
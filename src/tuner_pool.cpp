@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cancel_token.h"
+#include "logger.h"
+#include "tuner.h"
+#include "tuner_pool.h"
+
+namespace px4tsid
+{
+
+void TunerPool::set_devices(const std::vector<std::string>& devices)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	candidates_.clear();
+	for (const auto& device : devices)
+	{
+		candidates_.push_back({ device, 0, false });
+	}
+	next_ = 0;
+}
+
+void TunerPool::acquire(Tuner& device, const CancelToken* cancel)
+{
+	using namespace std::chrono_literals;
+	auto start = std::chrono::steady_clock::now();
+	auto backoff = 100ms;
+
+	while (true)
+	{
+		auto has_healthy = false;
+		if (try_acquire(device, has_healthy))
+		{
+			return;
+		}
+
+		if (!has_healthy)
+		{
+			throw std::runtime_error("no healthy tuner");
+		}
+
+		auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+		if (waited >= busy_wait_)
+		{
+			throw BusyError("all tuners are busy");
+		}
+
+		auto wait = std::min(backoff, busy_wait_ - waited);
+		PX4TSID_LOG(LogLevel::info, "no idle tuner, retry after %lldms", static_cast<long long>(wait.count()));
+		for (auto end = std::chrono::steady_clock::now() + wait; std::chrono::steady_clock::now() < end; )
+		{
+			if (cancel != nullptr && cancel->is_cancelled())
+			{
+				throw std::runtime_error("catch signal");
+			}
+			std::this_thread::sleep_for(std::min(wait, std::chrono::milliseconds(100)));
+		}
+		backoff = std::min(backoff * 2, std::chrono::milliseconds(5000));
+	}
+}
+
+void TunerPool::release(Tuner& device, bool is_failed)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	auto c = find(device.device());
+	device.close_tuner();
+	if (c == nullptr)
+	{
+		return;
+	}
+
+	c->in_use = false;
+	if (is_failed)
+	{
+		c->failures++;
+		if (c->failures >= max_failures_)
+		{
+			PX4TSID_LOG(LogLevel::warn, "%s : marked unhealthy", c->device.c_str());
+		}
+	}
+	else
+	{
+		c->failures = 0;
+	}
+}
+
+bool TunerPool::is_healthy(const std::string& device) const
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (const auto& c : candidates_)
+	{
+		if (c.device == device)
+		{
+			return c.failures < max_failures_;
+		}
+	}
+	return false;
+}
+
+bool TunerPool::try_acquire(Tuner& device, bool& has_healthy)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	has_healthy = false;
+
+	for (size_t i = 0; i < candidates_.size(); i++)
+	{
+		auto& c = candidates_.at((next_ + i) % candidates_.size());
+		if (c.failures >= max_failures_)
+		{
+			continue;
+		}
+		has_healthy = true;
+		if (c.in_use)
+		{
+			continue;
+		}
+
+		try
+		{
+			device.open_tuner(c.device);
+		}
+		catch (const BusyError&)
+		{
+			continue;
+		}
+		catch (const std::exception& e)
+		{
+			PX4TSID_LOG(LogLevel::warn, "%s", e.what());
+			c.failures++;
+			continue;
+		}
+
+		if (!device.lock_tuner())
+		{
+			device.close_tuner();
+			continue;
+		}
+
+		c.in_use = true;
+		next_ = (next_ + i + 1) % candidates_.size();
+		return true;
+	}
+
+	return false;
+}
+
+TunerPool::Candidate* TunerPool::find(const std::string& device)
+{
+	for (auto& c : candidates_)
+	{
+		if (c.device == device)
+		{
+			return &c;
+		}
+	}
+	return nullptr;
+}
+
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstdint>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cancel_token.h"
+#include "tuner.h"
+
+namespace px4tsid
+{
+
+// Picks an idle tuner out of candidate devices. A tuner is busy when
+// open() fails with EBUSY or another process holds flock() on it.
+class TunerPool
+{
+public:
+	TunerPool() = default;
+	~TunerPool() = default;
+
+	void set_devices(const std::vector<std::string>& devices);
+	void set_busy_wait(std::chrono::milliseconds wait) { busy_wait_ = wait; }
+	void set_max_failures(int32_t count) { max_failures_ = count; }
+	void acquire(Tuner& device, const CancelToken* cancel = nullptr);
+	// takes an idle tuner without waiting
+	bool try_acquire(Tuner& device)
+	{
+		auto has_healthy = false;
+		return try_acquire(device, has_healthy);
+	}
+	void release(Tuner& device, bool is_failed = false);
+	bool is_healthy(const std::string& device) const;
+
+private:
+	struct Candidate
+	{
+		std::string device;
+		int32_t failures;
+		bool in_use;
+	};
+
+	mutable std::mutex mutex_;
+	std::vector<Candidate> candidates_;
+	std::chrono::milliseconds busy_wait_{30000};
+	int32_t max_failures_ = 3;
+	size_t next_ = 0;
+
+	bool try_acquire(Tuner& device, bool& has_healthy);
+	Candidate* find(const std::string& device);
+};
+
+}
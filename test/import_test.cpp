@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdint>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "json.hpp"
+
+#include "chset.h"
+#include "convert.h"
+#include "import.h"
+#include "test.h"
+
+using namespace px4tsid;
+
+namespace
+{
+
+using Slot = std::tuple<int32_t, int32_t, uint16_t>;
+
+nlohmann::json load_table()
+{
+	std::ifstream ifs(PX4TSID_TEST_TABLE);
+	return nlohmann::json::parse(ifs);
+}
+
+std::set<Slot> found_slots(const nlohmann::json& table)
+{
+	std::set<Slot> slots;
+	for (const auto& band : { "BS", "CS" })
+	{
+		for (const auto& c : table.at(band).get<std::vector<ChSet>>())
+		{
+			if (!c.has_lock()) continue;
+			for (size_t slot = 0; slot < c.transport_stream_id().size(); slot++)
+			{
+				if (c.transport_stream_id(slot) != 0xffff)
+				{
+					slots.insert({ c.frequency_idx(), static_cast<int32_t>(slot), c.transport_stream_id(slot) });
+				}
+			}
+		}
+	}
+	return slots;
+}
+
+// an imported entry lacks what its format does not write, the slot or the TSID
+bool matches(const Import::Entry& e, const Slot& s)
+{
+	return e.frequency_idx == std::get<0>(s)
+		&& (e.slot < 0 || e.slot == std::get<1>(s))
+		&& (e.transport_stream_id == 0xffff || e.transport_stream_id == std::get<2>(s))
+		&& (e.slot >= 0 || e.transport_stream_id != 0xffff);
+}
+
+void test_round_trip(const nlohmann::json& table)
+{
+	auto expected = found_slots(table);
+	CHECK(!expected.empty());
+
+	for (const auto& format : { "json", "dvbv5", "dvbv5lnb", "dvbv5tsid", "dvbv5lnbtsid", "mirakurun", "mirakuruntsid",
+		"bondvb", "bonpt", "bonptx", "bonpx4" })
+	{
+		std::istringstream is(Convert::dump(format, table));
+		auto entries = Import::parse(format, is);
+		CHECK(entries.size() == expected.size());
+
+		// every channel written comes back as exactly one slot of the table
+		auto left = expected;
+		for (const auto& e : entries)
+		{
+			auto it = left.begin();
+			while (it != left.end() && !matches(e, *it)) { ++it; }
+			if (it == left.end())
+			{
+				std::cerr << format << ": " << e.name << " not in the table\n";
+				CHECK(it != left.end());
+				continue;
+			}
+			left.erase(it);
+		}
+		CHECK(left.empty());
+
+		// and checks out against the table it was written from
+		for (const auto& r : Import::verify(entries, table))
+		{
+			CHECK(r.at("status") == "ok");
+		}
+	}
+}
+
+void test_verify_stale(const nlohmann::json& table)
+{
+	std::istringstream is(Convert::dump("dvbv5tsid", table));
+	auto entries = Import::parse("dvbv5tsid", is);
+
+	// BS1 TS0 went off the air
+	auto moved = table;
+	moved.at("BS").at(0).at("transport_stream_id").at(0) = 0xffff;
+	auto stale = 0;
+	for (const auto& r : Import::verify(entries, moved))
+	{
+		if (r.at("status") == "stale")
+		{
+			CHECK(r.at("expected_tsid") == table.at("BS").at(0).at("transport_stream_id").at(0));
+			stale++;
+		}
+	}
+	CHECK(stale == 1);
+}
+
+void test_plan()
+{
+	std::vector<Import::Entry> entries = {
+		{ "BS01_0", 0, 0, 0x4010 },
+		{ "16433", 1, -1, 0x4031 },
+		{ "CS2", 12, 0, 0xffff },
+	};
+	auto plan = Import::plan(entries, 3);
+	CHECK(plan.bs().size() == 2);
+	CHECK(plan.bs().at(0).slots() == std::vector<int32_t>{0});
+	// no slot in the file, search the first ts_number_size
+	CHECK(plan.bs().at(1).slots() == (std::vector<int32_t>{0, 1, 2}));
+	CHECK(plan.cs().size() == 1);
+	CHECK(plan.cs().at(0).transponder() == "ND2");
+}
+
+void test_invalid()
+{
+	std::istringstream unknown("");
+	CHECK_THROWS(Import::parse("ndjson", unknown));
+	// no transponder on the frequency
+	std::istringstream bad_frequency("[BS01_0]\n\tDELIVERY_SYSTEM = ISDBS\n\tFREQUENCY = 1000000\n\tSTREAM_ID = 0\n");
+	CHECK_THROWS(Import::parse("dvbv5", bad_frequency));
+	std::istringstream bad_number("[BS01_0]\n\tDELIVERY_SYSTEM = ISDBS\n\tFREQUENCY = 1049480\n\tSTREAM_ID = x\n");
+	CHECK_THROWS(Import::parse("dvbv5", bad_number));
+}
+
+}
+
+int main()
+{
+	auto table = load_table();
+	test_round_trip(table);
+	test_verify_stale(table);
+	test_plan();
+	test_invalid();
+	return test::result();
+}
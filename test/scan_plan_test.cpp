@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+#include "scan_plan.h"
+#include "test.h"
+
+using namespace px4tsid;
+
+namespace
+{
+
+ScanPlan load(const std::string& dir, const std::string& text)
+{
+	ScanPlan plan;
+	plan.load(test::write_file(dir + "/plan.json", text));
+	return plan;
+}
+
+void test_defaults_from_frequency_idx(const std::string& dir)
+{
+	auto plan = load(dir, R"({"BS": [{"frequency_idx": 1}], "CS": [{"frequency_idx": 12, "slots": []}]})");
+	CHECK(plan.bs().size() == 1);
+	CHECK(plan.bs().at(0).transponder() == "BS3");
+	CHECK(plan.bs().at(0).number() == 3);
+	CHECK(plan.bs().at(0).frequency_khz() == 11765840);
+	CHECK(plan.bs().at(0).slots() == std::vector<int32_t>{0});
+	CHECK(plan.bs().at(0).retry_count() == 0);
+	CHECK(plan.cs().size() == 1);
+	CHECK(plan.cs().at(0).transponder() == "ND2");
+	CHECK(plan.cs().at(0).number() == 2);
+	CHECK(plan.cs().at(0).frequency_khz() == 12291000);
+	CHECK(plan.cs().at(0).slots().empty());
+}
+
+void test_matching_fields(const std::string& dir)
+{
+	auto plan = load(dir, R"({"BS": [{"transponder": "BS3", "number": 3, "frequency_idx": 1,
+		"frequency_khz": 11765840, "slots": [2, 0], "retry_count": 5, "timeout_ms": 700}]})");
+	CHECK(plan.bs().at(0).slots() == (std::vector<int32_t>{2, 0}));
+	CHECK(plan.bs().at(0).retry_count() == 5);
+	CHECK(plan.bs().at(0).timeout_ms() == 700);
+}
+
+void test_rejects(const std::string& dir)
+{
+	// fields that disagree with the frequency_idx the tuner is set by
+	CHECK_THROWS(load(dir, R"({"BS": [{"transponder": "BS00", "frequency_idx": 1}]})"));
+	CHECK_THROWS(load(dir, R"({"BS": [{"number": 0, "frequency_idx": 1}]})"));
+	CHECK_THROWS(load(dir, R"({"BS": [{"frequency_idx": 1, "frequency_khz": 11727480}]})"));
+	// the other band, out of range
+	CHECK_THROWS(load(dir, R"({"BS": [{"frequency_idx": 12}]})"));
+	CHECK_THROWS(load(dir, R"({"CS": [{"frequency_idx": 11}]})"));
+	CHECK_THROWS(load(dir, R"({"CS": [{"frequency_idx": 24}]})"));
+	CHECK_THROWS(load(dir, R"({"BS": [{"frequency_idx": -1}]})"));
+	// duplicates, slots out of range
+	CHECK_THROWS(load(dir, R"({"BS": [{"frequency_idx": 1}, {"frequency_idx": 1}]})"));
+	CHECK_THROWS(load(dir, R"({"BS": [{"frequency_idx": 1, "slots": [1, 2, 1]}]})"));
+	CHECK_THROWS(load(dir, R"({"BS": [{"frequency_idx": 1, "slots": [8]}]})"));
+	CHECK_THROWS(load(dir, R"({"BS": [{"frequency_idx": 1, "slots": [-1]}]})"));
+	// not a plan
+	CHECK_THROWS(load(dir, R"({"BS": [{"transponder": "BS1"}]})"));
+	CHECK_THROWS(load(dir, "{"));
+	CHECK_THROWS(ScanPlan().load(dir + "/missing.json"));
+}
+
+void test_default_plan()
+{
+	ScanPlan plan;
+	plan.set_default(4);
+	CHECK(plan.bs().size() == ScanPlan::TRANSPONDER_SIZE_BS);
+	CHECK(plan.cs().size() == ScanPlan::TRANSPONDER_SIZE_CS);
+	for (const auto* entries : { &plan.bs(), &plan.cs() })
+	{
+		for (const auto& e : *entries)
+		{
+			auto expected = ScanPlan::entry(e.frequency_idx(), e.slots());
+			CHECK(e.transponder() == expected.transponder());
+			CHECK(e.number() == expected.number());
+			CHECK(e.frequency_khz() == expected.frequency_khz());
+		}
+	}
+	CHECK(plan.bs().at(0).slots() == (std::vector<int32_t>{0, 1, 2, 3}));
+	CHECK(plan.cs().at(0).slots() == std::vector<int32_t>{0});
+}
+
+void test_round_trip_json()
+{
+	auto entry = ScanPlan::entry(13, { 0 });
+	entry.set_retry_count(3);
+	auto copy = nlohmann::json(entry).get<PlanEntry>();
+	CHECK(copy.transponder() == "ND4");
+	CHECK(copy.frequency_idx() == 13);
+	CHECK(copy.frequency_khz() == entry.frequency_khz());
+	CHECK(copy.retry_count() == 3);
+}
+
+void test_frequency_idx_lookups()
+{
+	for (auto idx = 0; idx < ScanPlan::TRANSPONDER_SIZE_BS + ScanPlan::TRANSPONDER_SIZE_CS; idx++)
+	{
+		auto khz = ScanPlan::frequency_khz(idx);
+		CHECK(ScanPlan::frequency_idx_from_khz(khz) == idx);
+		CHECK(ScanPlan::frequency_idx_from_khz(khz - ScanPlan::LNB_LOCAL_KHZ) == idx);
+		CHECK(ScanPlan::frequency_idx_from_khz(khz + 1500) == idx);
+	}
+	CHECK(ScanPlan::frequency_idx_from_khz(11000000) == -1);
+	// BS1 TS0, BS15 TS1, ND2, ND24
+	CHECK(ScanPlan::frequency_idx_from_tsid(0x4010) == 0);
+	CHECK(ScanPlan::frequency_idx_from_tsid(0x40f1) == 7);
+	CHECK(ScanPlan::frequency_idx_from_tsid(0x6020) == 12);
+	CHECK(ScanPlan::frequency_idx_from_tsid(0x7180) == 23);
+	CHECK(ScanPlan::frequency_idx_from_tsid(0x1234) == -1);
+}
+
+}
+
+int main()
+{
+	test::TempDir dir;
+	test_defaults_from_frequency_idx(dir.path());
+	test_matching_fields(dir.path());
+	test_rejects(dir.path());
+	test_default_plan();
+	test_round_trip_json();
+	test_frequency_idx_lookups();
+	return test::result();
+}
@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <getopt.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json.hpp"
+
+#include "cancel_token.h"
+#include "config.h"
+#include "single_flight.h"
+#include "test.h"
+#include "tsid_scan.h"
+
+using namespace px4tsid;
+
+namespace
+{
+
+Config parse(std::vector<std::string> args)
+{
+	args.insert(args.begin(), "px4tsid");
+	std::vector<char*> argv;
+	for (auto& arg : args)
+	{
+		argv.push_back(arg.data());
+	}
+	argv.push_back(nullptr);
+	// getopt keeps its position between calls
+	optind = 0;
+	Config config;
+	config.parse(static_cast<int>(args.size()), argv.data());
+	return config;
+}
+
+void test_key()
+{
+	auto base = SingleFlight::key(parse({ "/dev/px4video0", "/dev/px4video2" }));
+	// devices in any order, output options
+	CHECK(SingleFlight::key(parse({ "/dev/px4video2", "/dev/px4video0" })) == base);
+	CHECK(SingleFlight::key(parse({ "--format=dvbv5", "/dev/px4video0", "/dev/px4video2" })) == base);
+	CHECK(SingleFlight::key(parse({ "--quiet", "/dev/px4video0", "/dev/px4video2" })) == base);
+	CHECK(SingleFlight::lock_path(base) == SingleFlight::lock_path(SingleFlight::key(parse({ "/dev/px4video2", "/dev/px4video0" }))));
+
+	// everything that changes what the scan finds
+	for (const auto& option : { "--stats", "--stats-window=2000", "--scan-timeout=30", "--time-budget=10",
+		"--lnb", "--ts-number-size=2", "--ignore=0x4010" })
+	{
+		auto key = SingleFlight::key(parse({ option, "/dev/px4video0", "/dev/px4video2" }));
+		CHECK(key != base);
+		CHECK(SingleFlight::lock_path(key) != SingleFlight::lock_path(base));
+	}
+	CHECK(SingleFlight::key(parse({ "/dev/px4video0" })) != base);
+}
+
+void test_paths(const std::string& dir)
+{
+	auto key = SingleFlight::key(parse({ "/dev/px4video0" }));
+	auto lock = SingleFlight::lock_path(key);
+	auto result = SingleFlight::result_path(key);
+	CHECK(lock.rfind(dir + "/px4tsid/singleflight-", 0) == 0);
+	CHECK(lock.size() > 5 && lock.substr(lock.size() - 5) == ".lock");
+	CHECK(result.substr(0, result.size() - 5) == lock.substr(0, lock.size() - 5));
+	CHECK(result.substr(result.size() - 5) == ".json");
+}
+
+void test_waiter_takes_result()
+{
+	auto config = parse({ "/dev/px4video0" });
+	CancelToken cancel;
+	SingleFlight leader;
+	leader.init(config);
+	CHECK(!leader.join(cancel).has_value());
+
+	auto waiter = std::async(std::launch::async, [&config, &cancel] {
+		SingleFlight flight;
+		flight.init(config);
+		return flight.join(cancel);
+	});
+	CHECK(waiter.wait_for(SingleFlight::POLL_INTERVAL * 3) == std::future_status::timeout);
+
+	TSIDScan scan;
+	leader.publish(scan);
+	auto table = waiter.get();
+	CHECK(table.has_value());
+	CHECK(table && *table == nlohmann::json::parse(R"({"BS": [], "CS": []})"));
+}
+
+void test_old_result_ignored()
+{
+	auto config = parse({ "/dev/px4video0" });
+	CancelToken cancel;
+	{
+		// the result of an earlier scan is still there
+		SingleFlight earlier;
+		earlier.init(config);
+		CHECK(!earlier.join(cancel).has_value());
+		earlier.publish(TSIDScan());
+	}
+	CHECK(std::filesystem::exists(SingleFlight::result_path(SingleFlight::key(config))));
+	std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+	// the lock is free, no wait and no table
+	{
+		SingleFlight flight;
+		flight.init(config);
+		CHECK(!flight.join(cancel).has_value());
+	}
+
+	// a leader that gives up publishes nothing, its waiter scans instead of taking the old result
+	auto leader = std::make_unique<SingleFlight>();
+	leader->init(config);
+	CHECK(!leader->join(cancel).has_value());
+	auto waiter = std::async(std::launch::async, [&config, &cancel] {
+		SingleFlight flight;
+		flight.init(config);
+		return flight.join(cancel);
+	});
+	std::this_thread::sleep_for(SingleFlight::POLL_INTERVAL * 2);
+	leader.reset();
+	CHECK(!waiter.get().has_value());
+}
+
+void test_cancelled_waiter()
+{
+	auto config = parse({ "/dev/px4video0" });
+	CancelToken cancel;
+	SingleFlight leader;
+	leader.init(config);
+	CHECK(!leader.join(cancel).has_value());
+
+	CancelToken waiter_cancel;
+	waiter_cancel.cancel();
+	SingleFlight waiter;
+	waiter.init(config);
+	CHECK_THROWS(waiter.join(waiter_cancel));
+}
+
+}
+
+int main()
+{
+	test::TempDir dir;
+	// the lock and result files go next to the probe cache
+	::setenv("XDG_CACHE_HOME", dir.path().c_str(), 1);
+	test_key();
+	test_paths(dir.path());
+	test_waiter_takes_result();
+	test_old_result_ignored();
+	test_cancelled_waiter();
+	return test::result();
+}
@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <stdlib.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace px4tsid::test
+{
+
+// Checks for the unit tests: a failed check prints the expression and the
+// test goes on, result() turns the count of failures into the exit code.
+inline int32_t& failures()
+{
+	static int32_t count = 0;
+	return count;
+}
+
+inline void check(bool is_ok, const char* expr, const char* file, int32_t line)
+{
+	if (!is_ok)
+	{
+		std::cerr << file << ':' << line << ": CHECK(" << expr << ") failed\n";
+		failures()++;
+	}
+}
+
+template <typename F>
+void check_throws(F&& f, const char* expr, const char* file, int32_t line)
+{
+	try
+	{
+		f();
+	}
+	catch (const std::exception&)
+	{
+		return;
+	}
+	std::cerr << file << ':' << line << ": CHECK_THROWS(" << expr << ") did not throw\n";
+	failures()++;
+}
+
+inline int result()
+{
+	if (failures() > 0)
+	{
+		std::cerr << failures() << " check(s) failed\n";
+		return 1;
+	}
+	return 0;
+}
+
+// a fresh directory under TMPDIR, removed at the end unless a check failed
+class TempDir
+{
+public:
+	TempDir()
+	{
+		auto tmp = std::getenv("TMPDIR");
+		path_ = std::string(tmp != nullptr && tmp[0] == '/' ? tmp : "/tmp") + "/px4tsid_test.XXXXXX";
+		if (::mkdtemp(path_.data()) == nullptr)
+		{
+			throw std::runtime_error("failed to create " + path_);
+		}
+	}
+	~TempDir()
+	{
+		if (failures() == 0)
+		{
+			std::error_code ec;
+			std::filesystem::remove_all(path_, ec);
+		}
+	}
+	TempDir(const TempDir&) = delete;
+	TempDir& operator=(const TempDir&) = delete;
+
+	const std::string& path() const { return path_; }
+
+private:
+	std::string path_;
+};
+
+inline std::string write_file(const std::string& path, const std::string& text)
+{
+	std::ofstream ofs(path);
+	ofs << text;
+	return path;
+}
+
+// a PAT section starting in the packet, just what TSParser::parse_pat() reads
+inline std::array<uint8_t, 188> pat_packet(uint16_t tsid, uint8_t version, uint8_t cc = 0)
+{
+	std::array<uint8_t, 188> p;
+	p.fill(0xff);
+	p[0] = 0x47;
+	p[1] = 0x40;
+	p[2] = 0x00;
+	p[3] = 0x10 | (cc & 0x0f);
+	p[4] = 0x00;
+	p[5] = 0x00;
+	p[6] = 0xb0;
+	p[7] = 13;
+	p[8] = tsid >> 8;
+	p[9] = tsid & 0xff;
+	p[10] = 0xc1 | (version & 0x1f) << 1;
+	return p;
+}
+
+inline std::array<uint8_t, 188> data_packet(uint16_t pid, uint8_t cc)
+{
+	std::array<uint8_t, 188> p;
+	p.fill(0x00);
+	p[0] = 0x47;
+	p[1] = (pid >> 8) & 0x1f;
+	p[2] = pid & 0xff;
+	p[3] = 0x10 | (cc & 0x0f);
+	return p;
+}
+
+}
+
+#define CHECK(expr) px4tsid::test::check(static_cast<bool>(expr), #expr, __FILE__, __LINE__)
+#define CHECK_THROWS(expr) px4tsid::test::check_throws([&] { expr; }, #expr, __FILE__, __LINE__)
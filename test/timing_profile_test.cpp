@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cmath>
+#include <cstdint>
+#include <chrono>
+#include <string>
+
+#include "timing_profile.h"
+#include "test.h"
+
+using namespace px4tsid;
+using std::chrono::milliseconds;
+
+namespace
+{
+
+const std::string DEVICE = "/dev/px4video0";
+
+bool near(double a, double b)
+{
+	return std::abs(a - b) < 1e-9;
+}
+
+void test_ewma()
+{
+	TimingProfile profile;
+	CHECK(profile.empty());
+	CHECK(profile.find(DEVICE, 0, 0) == nullptr);
+
+	// the first success is taken as it is, later ones move by ALPHA
+	profile.update(DEVICE, 0, 0, true, milliseconds(100), milliseconds(200));
+	auto e = profile.find(DEVICE, 0, 0);
+	CHECK(e != nullptr);
+	CHECK(e->samples == 1);
+	CHECK(e->successes == 1);
+	CHECK(near(e->lock_ms, 100));
+	CHECK(near(e->pat_ms, 200));
+	CHECK(near(e->failure_rate, 0));
+
+	profile.update(DEVICE, 0, 0, true, milliseconds(200), milliseconds(100));
+	CHECK(near(e->lock_ms, 130));
+	CHECK(near(e->pat_ms, 170));
+
+	// a failure only moves the failure rate
+	profile.update(DEVICE, 0, 0, false, milliseconds(5000), milliseconds(5000));
+	CHECK(e->samples == 3);
+	CHECK(e->successes == 2);
+	CHECK(near(e->failure_rate, 0.3));
+	CHECK(near(e->lock_ms, 130));
+	CHECK(near(e->pat_ms, 170));
+	profile.update(DEVICE, 0, 0, false, milliseconds(0), milliseconds(0));
+	CHECK(near(e->failure_rate, 0.51));
+}
+
+void test_deadline()
+{
+	TimingProfile profile;
+	auto limit = milliseconds(10000);
+
+	// too few samples, the limit as without a profile
+	profile.update(DEVICE, 0, 0, true, milliseconds(100), milliseconds(200));
+	CHECK(profile.deadline(DEVICE, 0, 0, limit) == limit);
+	CHECK(!profile.is_expected(DEVICE, 0, 0));
+
+	// twice the learned time plus 200ms, at least 300ms, at most the limit
+	profile.update(DEVICE, 0, 0, true, milliseconds(100), milliseconds(200));
+	CHECK(profile.is_expected(DEVICE, 0, 0));
+	CHECK(profile.deadline(DEVICE, 0, 0, limit) == milliseconds(800));
+	CHECK(profile.deadline(DEVICE, 0, 0, milliseconds(500)) == milliseconds(500));
+	profile.update(DEVICE, 0, 1, true, milliseconds(10), milliseconds(10));
+	profile.update(DEVICE, 0, 1, true, milliseconds(10), milliseconds(10));
+	CHECK(profile.deadline(DEVICE, 0, 1, limit) == milliseconds(300));
+
+	// a slot that keeps failing gets as long as the slowest working slot of the device
+	profile.update(DEVICE, 0, 2, false, milliseconds(0), milliseconds(0));
+	profile.update(DEVICE, 0, 2, false, milliseconds(0), milliseconds(0));
+	CHECK(!profile.is_expected(DEVICE, 0, 2));
+	CHECK(profile.deadline(DEVICE, 0, 2, limit) == milliseconds(800));
+	// another device has learned nothing
+	profile.update("/dev/px4video1", 0, 2, false, milliseconds(0), milliseconds(0));
+	profile.update("/dev/px4video1", 0, 2, false, milliseconds(0), milliseconds(0));
+	CHECK(profile.deadline("/dev/px4video1", 0, 2, limit) == limit);
+
+	CHECK(near(profile.failure_rate(DEVICE, 0), (0 + 0 + 0.51) / 3));
+	CHECK(near(profile.failure_rate(DEVICE, 1), 0));
+}
+
+void test_save_load(const std::string& dir)
+{
+	TimingProfile profile;
+	profile.update(DEVICE, 3, 1, true, milliseconds(120), milliseconds(340));
+	profile.update(DEVICE, 3, 1, false, milliseconds(0), milliseconds(0));
+	profile.save(dir + "/profile.json");
+
+	TimingProfile loaded;
+	loaded.load(dir + "/profile.json");
+	auto e = loaded.find(DEVICE, 3, 1);
+	CHECK(e != nullptr);
+	CHECK(e->samples == 2);
+	CHECK(e->successes == 1);
+	CHECK(near(e->failure_rate, 0.3));
+	CHECK(near(e->lock_ms, 120));
+	CHECK(near(e->pat_ms, 340));
+
+	// a missing file is an empty profile
+	loaded.load(dir + "/missing.json");
+	CHECK(loaded.empty());
+}
+
+void test_invalid_file(const std::string& dir)
+{
+	// not json, an old schema, an entry of the wrong type: start from an empty profile
+	for (const auto& text : {
+		std::string("{"),
+		std::string(R"({"entries": []})"),
+		std::string(R"({"slots": [{"device": "/dev/px4video0", "frequency_idx": 0, "slot": 0, "samples": 2,
+			"successes": 2, "failure_rate": 0, "lock_ms": 100, "pat_ms": 100}, {"device": 1}]})"),
+	})
+	{
+		TimingProfile profile;
+		profile.update(DEVICE, 0, 0, true, milliseconds(100), milliseconds(200));
+		profile.load(test::write_file(dir + "/invalid.json", text));
+		CHECK(profile.empty());
+	}
+}
+
+}
+
+int main()
+{
+	test::TempDir dir;
+	test_ewma();
+	test_deadline();
+	test_save_load(dir.path());
+	test_invalid_file(dir.path());
+	return test::result();
+}
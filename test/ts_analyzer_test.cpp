@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ts_analyzer.h"
+#include "test.h"
+
+using namespace px4tsid;
+
+namespace
+{
+
+// TSAnalyzer::CHUNK_SIZE, the file has to run past it for a second chunk
+constexpr uint64_t CHUNK_SIZE = 64 * 1024 * 1024;
+
+struct Stream
+{
+	std::vector<uint8_t> data;
+	std::vector<PATChange> changes;
+	uint64_t packets = 0;
+
+	void add(const std::array<uint8_t, 188>& p)
+	{
+		data.insert(data.end(), p.begin(), p.end());
+		packets++;
+	}
+	void add_pat(uint16_t tsid, uint8_t version)
+	{
+		if (changes.empty() || changes.back().transport_stream_id != tsid || changes.back().version != version)
+		{
+			changes.push_back({ data.size(), tsid, version });
+		}
+		add(test::pat_packet(tsid, version));
+	}
+	// a PAT every 100 packets until the stream reaches size
+	void fill(uint64_t size, uint16_t tsid, uint8_t version)
+	{
+		for (uint8_t cc = 0; data.size() + 188 <= size; cc++)
+		{
+			if (packets % 100 == 0)
+			{
+				add_pat(tsid, version);
+				continue;
+			}
+			add(test::data_packet(0x100, cc));
+		}
+	}
+};
+
+void check_timeline(const TSAnalyzer& analyzer, const Stream& stream)
+{
+	CHECK(analyzer.size() == stream.data.size());
+	CHECK(analyzer.packets() == stream.packets);
+	CHECK(analyzer.timeline().size() == stream.changes.size());
+	for (size_t i = 0; i < stream.changes.size() && i < analyzer.timeline().size(); i++)
+	{
+		CHECK(analyzer.timeline().at(i).offset == stream.changes.at(i).offset);
+		CHECK(analyzer.timeline().at(i).transport_stream_id == stream.changes.at(i).transport_stream_id);
+		CHECK(analyzer.timeline().at(i).version == stream.changes.at(i).version);
+	}
+}
+
+void test_chunk_edges(const std::string& dir)
+{
+	// 64MB is no multiple of 188, the second chunk starts in the middle of a packet
+	Stream stream;
+	stream.fill(CHUNK_SIZE - 188 * 10, 0x4010, 0);
+	// a change in the packet across the chunk edge, and one just after it
+	stream.fill(CHUNK_SIZE, 0x4010, 0);
+	CHECK(stream.data.size() < CHUNK_SIZE && stream.data.size() + 188 > CHUNK_SIZE);
+	stream.add_pat(0x4011, 0);
+	stream.add_pat(0x4011, 1);
+	stream.fill(CHUNK_SIZE + 188 * 1000, 0x4011, 1);
+	CHECK(stream.changes.size() == 3);
+
+	auto path = dir + "/edges.ts";
+	std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(stream.data.data()), stream.data.size());
+	// one thread and one per chunk find the same
+	for (auto threads : { 1u, 2u })
+	{
+		TSAnalyzer analyzer;
+		analyzer.set_threads(threads);
+		analyzer.analyze(path);
+		CHECK(analyzer.sync_losses() == 0);
+		check_timeline(analyzer, stream);
+	}
+}
+
+void test_resync(const std::string& dir)
+{
+	// stray bytes that start with a sync byte cost one sync loss, not the packet after them
+	Stream stream;
+	stream.fill(188 * 500, 0x4010, 0);
+	stream.data.insert(stream.data.end(), { 0x47, 0x00, 0x47, 0x00, 0x00 });
+	auto garbage = stream.data.size();
+	stream.add_pat(0x4031, 2);
+	stream.fill(188 * 1000, 0x4031, 2);
+	CHECK(stream.changes.at(1).offset == garbage);
+
+	auto path = dir + "/resync.ts";
+	std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(stream.data.data()), stream.data.size());
+	TSAnalyzer analyzer;
+	analyzer.analyze(path);
+	CHECK(analyzer.sync_losses() == 1);
+	check_timeline(analyzer, stream);
+}
+
+void test_empty(const std::string& dir)
+{
+	TSAnalyzer analyzer;
+	analyzer.analyze(test::write_file(dir + "/empty.ts", ""));
+	CHECK(analyzer.packets() == 0);
+	CHECK(analyzer.timeline().empty());
+	CHECK_THROWS(analyzer.analyze(dir + "/missing.ts"));
+}
+
+}
+
+int main()
+{
+	test::TempDir dir;
+	test_chunk_edges(dir.path());
+	test_resync(dir.path());
+	test_empty(dir.path());
+	return test::result();
+}
@@ -0,0 +1,141 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include "ts_parser.h"
+#include "test.h"
+
+using namespace px4tsid;
+
+namespace
+{
+
+std::vector<uint8_t> make_stream()
+{
+	std::vector<uint8_t> stream;
+	auto add = [&](const std::array<uint8_t, 188>& p) { stream.insert(stream.end(), p.begin(), p.end()); };
+	add(test::data_packet(0x100, 0));
+	add(test::data_packet(0x100, 1));
+	add(test::pat_packet(0x4031, 3));
+	add(test::data_packet(0x100, 2));
+	add(test::data_packet(0x100, 3));
+	return stream;
+}
+
+// the PAT and the packets of the stream however it is cut into reads
+void check_split(const std::vector<uint8_t>& stream, const std::vector<size_t>& cuts)
+{
+	TSParser parser;
+	parser.set_stats(true);
+	uint16_t found = 0xffff;
+	auto pats = 0;
+	size_t pos = 0;
+	for (auto cut : cuts)
+	{
+		uint16_t tsid;
+		CHECK(parser.get_transport_stream_id(stream.data() + pos, cut - pos, tsid) == 0);
+		if (tsid != 0xffff)
+		{
+			found = tsid;
+			pats++;
+		}
+		pos = cut;
+	}
+
+	CHECK(found == 0x4031);
+	CHECK(pats == 1);
+	// the last packet waits for the sync byte of the next one
+	auto stats = parser.stats(std::chrono::seconds(1));
+	CHECK(stats.packets == stream.size() / 188 - 1);
+	CHECK(stats.transport_errors == 0);
+	CHECK(stats.pids.size() == 2);
+	for (const auto& pid : stats.pids)
+	{
+		CHECK(pid.cc_errors == 0);
+	}
+}
+
+void test_split_at_every_offset()
+{
+	auto stream = make_stream();
+	for (size_t cut = 0; cut <= stream.size(); cut++)
+	{
+		check_split(stream, { cut, stream.size() });
+	}
+}
+
+void test_split_into_small_reads()
+{
+	auto stream = make_stream();
+	for (size_t step : { 1, 7, 187, 189 })
+	{
+		std::vector<size_t> cuts;
+		for (size_t cut = step; cut < stream.size(); cut += step)
+		{
+			cuts.push_back(cut);
+		}
+		cuts.push_back(stream.size());
+		check_split(stream, cuts);
+	}
+}
+
+void test_resync()
+{
+	// a stray byte in front of the stream is skipped, not taken as a packet
+	auto stream = make_stream();
+	stream.insert(stream.begin(), 0x47);
+	TSParser parser;
+	parser.set_stats(true);
+	uint16_t tsid;
+	parser.get_transport_stream_id(stream.data(), stream.size(), tsid);
+	CHECK(tsid == 0x4031);
+	CHECK(parser.stats(std::chrono::seconds(1)).packets == 4);
+
+	// clear() drops the carried bytes of the last stream
+	parser.clear();
+	auto next = make_stream();
+	parser.get_transport_stream_id(next.data() + 100, next.size() - 100, tsid);
+	CHECK(parser.stats(std::chrono::seconds(1)).packets == 3);
+}
+
+void test_counters()
+{
+	std::vector<uint8_t> stream;
+	auto add = [&](const std::array<uint8_t, 188>& p) { stream.insert(stream.end(), p.begin(), p.end()); };
+	add(test::data_packet(0x100, 0));
+	add(test::data_packet(0x100, 1));
+	// a duplicate keeps its counter, a skip is one error
+	add(test::data_packet(0x100, 1));
+	add(test::data_packet(0x100, 5));
+	auto error = test::data_packet(0x200, 0);
+	error[1] |= 0x80;
+	add(error);
+	add(test::data_packet(0x100, 6));
+
+	TSParser parser;
+	parser.set_stats(true);
+	uint16_t tsid;
+	CHECK(parser.get_transport_stream_id(stream.data(), stream.size(), tsid) == 1);
+	CHECK(tsid == 0xffff);
+	auto stats = parser.stats(std::chrono::milliseconds(500));
+	CHECK(stats.packets == 5);
+	CHECK(stats.transport_errors == 1);
+	CHECK(stats.bitrate_bps == 5 * 188 * 8 * 2);
+	CHECK(stats.pids.size() == 2);
+	CHECK(stats.pids.at(0).pid == 0x100);
+	CHECK(stats.pids.at(0).packets == 4);
+	CHECK(stats.pids.at(0).cc_errors == 1);
+}
+
+}
+
+int main()
+{
+	test_split_at_every_offset();
+	test_split_into_small_reads();
+	test_resync();
+	test_counters();
+	return test::result();
+}
@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ts_generator.h"
+
+namespace
+{
+
+constexpr size_t BUFFER_SIZE = 4 * 1024 * 1024;
+
+std::string usage(const std::string& argv0)
+{
+	return "\n"
+		"usage: " + argv0 + " [options] [OUTPUT]\n"
+		"\n"
+		"write a synthetic ISDB-S transport stream to OUTPUT (- for stdout)\n"
+		"\n"
+		"options:\n"
+		"  --help                     show this help message\n"
+		"  --tsid=TSID[,TSID...]      transport_stream_id of each slot (0x4010)\n"
+		"                             with several slots OUTPUT is a directory receiving TS<n>.ts\n"
+		"  --pat-version=n            version_number of PAT, PMT, NIT and SDT (0)\n"
+		"  --size=MB                  size of each stream (256)\n"
+		"  --bitrate=kbps             stream bitrate used for the table intervals and timestamps (30000)\n"
+		"  --pat-interval=ms          PAT/PMT repetition (100)\n"
+		"  --nit-interval=ms          NIT repetition (1000)\n"
+		"  --sdt-interval=ms          SDT repetition (1000)\n"
+		"  --null-ratio=x             fraction of null packets among the payload (0.1)\n"
+		"  --tei-rate=x               fraction of packets with transport_error_indicator set (0)\n"
+		"  --cc-error-rate=x          fraction of packets with a skipped continuity_counter (0)\n"
+		"  --sync-loss-rate=x         fraction of packets truncated to a random length (0)\n"
+		"  --packet-size=n            188, 192 (with timestamp) or 204 (with parity) (188)\n"
+		"  --seed=n                   random seed (1)\n";
+}
+
+uint32_t to_uint(const char* s, const char* name)
+{
+	char* end = nullptr;
+	errno = 0;
+	auto n = std::strtoul(s, &end, 0);
+	if (errno != 0 || end == s || *end != '\0' || n > UINT32_MAX)
+	{
+		throw std::runtime_error(std::string("invalid ") + name + " " + s);
+	}
+	return static_cast<uint32_t>(n);
+}
+
+double to_rate(const char* s, const char* name)
+{
+	char* end = nullptr;
+	auto x = std::strtod(s, &end);
+	if (end == s || *end != '\0' || x < 0 || x > 1)
+	{
+		throw std::runtime_error(std::string("invalid ") + name + " " + s);
+	}
+	return x;
+}
+
+std::vector<uint16_t> to_tsids(const std::string& s)
+{
+	std::vector<uint16_t> tsids;
+	std::istringstream is(s);
+	std::string item;
+	while (std::getline(is, item, ','))
+	{
+		auto tsid = to_uint(item.c_str(), "tsid");
+		if (tsid > 0xffff)
+		{
+			throw std::runtime_error("invalid tsid " + item);
+		}
+		tsids.push_back(static_cast<uint16_t>(tsid));
+	}
+	if (tsids.empty())
+	{
+		throw std::runtime_error("invalid tsid " + s);
+	}
+	return tsids;
+}
+
+uint64_t write_stream(const px4tsid::TSGenerator::Options& options, const std::string& path, uint64_t size)
+{
+	auto fd = path == "-" ? STDOUT_FILENO : ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		throw std::runtime_error("failed to open " + path + " : " + std::strerror(errno));
+	}
+
+	px4tsid::TSGenerator generator(options);
+	std::vector<uint8_t> buf(BUFFER_SIZE);
+	uint64_t written = 0;
+	try
+	{
+		while (written < size)
+		{
+			auto n = generator.generate(buf.data(), static_cast<size_t>(std::min<uint64_t>(buf.size(), size - written)));
+			if (n == 0) { break; }
+			for (size_t off = 0; off < n; )
+			{
+				auto r = ::write(fd, buf.data() + off, n - off);
+				if (r < 0)
+				{
+					if (errno == EINTR) { continue; }
+					throw std::runtime_error("failed to write " + path + " : " + std::strerror(errno));
+				}
+				off += r;
+			}
+			written += n;
+		}
+	}
+	catch (...)
+	{
+		if (fd != STDOUT_FILENO) { ::close(fd); }
+		throw;
+	}
+	if (fd != STDOUT_FILENO && ::close(fd) < 0)
+	{
+		throw std::runtime_error("failed to close " + path + " : " + std::strerror(errno));
+	}
+	return written;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	try
+	{
+		const option long_options[] = {
+			{"help", no_argument, 0, 'h'},
+			{"tsid", required_argument, 0, 't'},
+			{"pat-version", required_argument, 0, 'v'},
+			{"size", required_argument, 0, 's'},
+			{"bitrate", required_argument, 0, 'b'},
+			{"pat-interval", required_argument, 0, 'P'},
+			{"nit-interval", required_argument, 0, 'N'},
+			{"sdt-interval", required_argument, 0, 'S'},
+			{"null-ratio", required_argument, 0, 'n'},
+			{"tei-rate", required_argument, 0, 'e'},
+			{"cc-error-rate", required_argument, 0, 'c'},
+			{"sync-loss-rate", required_argument, 0, 'l'},
+			{"packet-size", required_argument, 0, 'p'},
+			{"seed", required_argument, 0, 'r'},
+			{0,0,0,0},
+		};
+
+		px4tsid::TSGenerator::Options options;
+		std::vector<uint16_t> tsids = { options.transport_stream_id };
+		uint64_t size = 256ULL * 1024 * 1024;
+		while (true)
+		{
+			auto option_index = 0;
+			auto c = getopt_long(argc, argv, "ht:v:s:b:P:N:S:n:e:c:l:p:r:", long_options, &option_index);
+			if (c == -1) { break; }
+			switch (c)
+			{
+			case 't':
+				tsids = to_tsids(optarg);
+				break;
+			case 'v':
+				options.version = static_cast<uint8_t>(to_uint(optarg, "pat-version") & 0x1f);
+				break;
+			case 's':
+				size = static_cast<uint64_t>(to_uint(optarg, "size")) * 1024 * 1024;
+				break;
+			case 'b':
+				options.bitrate_kbps = to_uint(optarg, "bitrate");
+				break;
+			case 'P':
+				options.pat_interval_ms = to_uint(optarg, "pat-interval");
+				break;
+			case 'N':
+				options.nit_interval_ms = to_uint(optarg, "nit-interval");
+				break;
+			case 'S':
+				options.sdt_interval_ms = to_uint(optarg, "sdt-interval");
+				break;
+			case 'n':
+				options.null_ratio = to_rate(optarg, "null-ratio");
+				break;
+			case 'e':
+				options.tei_rate = to_rate(optarg, "tei-rate");
+				break;
+			case 'c':
+				options.cc_error_rate = to_rate(optarg, "cc-error-rate");
+				break;
+			case 'l':
+				options.sync_loss_rate = to_rate(optarg, "sync-loss-rate");
+				break;
+			case 'p':
+				options.packet_size = to_uint(optarg, "packet-size");
+				break;
+			case 'r':
+				options.seed = std::strtoull(optarg, nullptr, 0);
+				break;
+			case 'h':
+			default:
+				throw std::runtime_error(usage(argv[0]));
+			}
+		}
+		if (optind + 1 < argc)
+		{
+			throw std::runtime_error(usage(argv[0]));
+		}
+		std::string output = optind < argc ? argv[optind] : "-";
+		if (tsids.size() > 1 && output == "-")
+		{
+			throw std::runtime_error("several slots need an output directory");
+		}
+
+		// one thread per slot, each stream seeded by its slot number
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::thread> threads;
+		std::vector<uint64_t> written(tsids.size());
+		std::vector<std::exception_ptr> errors(tsids.size());
+		for (size_t slot = 0; slot < tsids.size(); slot++)
+		{
+			auto o = options;
+			o.transport_stream_id = tsids.at(slot);
+			o.seed = options.seed + slot;
+			auto path = tsids.size() > 1 ? output + "/TS" + std::to_string(slot) + ".ts" : output;
+			threads.emplace_back([o, path, size, &n = written.at(slot), &error = errors.at(slot)] {
+				try
+				{
+					n = write_stream(o, path, size);
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
+			});
+		}
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+		for (const auto& e : errors)
+		{
+			if (e) { std::rethrow_exception(e); }
+		}
+
+		auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		auto total = std::accumulate(written.begin(), written.end(), uint64_t(0));
+		std::cerr << "wrote " << total << " bytes in " << elapsed << " s ("
+			<< static_cast<uint64_t>(total / 1e6 / std::max(elapsed, 1e-9)) << " MB/s)\n";
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << ex.what() << '\n';
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "ts_generator.h"
+
+namespace px4tsid
+{
+
+namespace
+{
+
+constexpr uint64_t ARRIVAL_CLOCK_HZ = 27000000;
+constexpr uint64_t ARRIVAL_TIME_MASK = (1ULL << 30) - 1;
+
+void put16(std::vector<uint8_t>& v, uint16_t n)
+{
+	v.push_back(n >> 8);
+	v.push_back(n & 0xff);
+}
+
+}
+
+TSGenerator::TSGenerator(const Options& options) : options_(options)
+{
+	if (options_.packet_size != 188 && options_.packet_size != 192 && options_.packet_size != 204)
+	{
+		throw std::runtime_error("packet size must be 188, 192 or 204");
+	}
+	if (options_.bitrate_kbps == 0)
+	{
+		throw std::runtime_error("bitrate must be positive");
+	}
+
+	auto tsid = options_.transport_stream_id;
+	auto version = static_cast<uint8_t>(0xc1 | ((options_.version & 0x1f) << 1));
+	auto network_id = static_cast<uint16_t>(tsid >> 12);
+	auto service_id = tsid;
+
+	// PAT : NIT and one service
+	std::vector<uint8_t> s = { 0x00, 0, 0 };
+	put16(s, tsid);
+	s.insert(s.end(), { version, 0x00, 0x00 });
+	put16(s, 0);
+	put16(s, 0xe000 | PID_NIT);
+	put16(s, service_id);
+	put16(s, 0xe000 | PID_PMT);
+	section_packet(pat_, PID_PAT, s);
+
+	// PMT : one MPEG-2 video stream carrying the PCR
+	s = { 0x02, 0, 0 };
+	put16(s, service_id);
+	s.insert(s.end(), { version, 0x00, 0x00 });
+	put16(s, 0xe000 | PID_VIDEO);
+	put16(s, 0xf000);
+	s.push_back(0x02);
+	put16(s, 0xe000 | PID_VIDEO);
+	put16(s, 0xf000);
+	section_packet(pmt_, PID_PMT, s);
+
+	// NIT actual : this transport stream only
+	s = { 0x40, 0, 0 };
+	put16(s, network_id);
+	s.insert(s.end(), { version, 0x00, 0x00 });
+	put16(s, 0xf000);
+	put16(s, 0xf000 | 6);
+	put16(s, tsid);
+	put16(s, network_id);
+	put16(s, 0xf000);
+	section_packet(nit_, PID_NIT, s);
+
+	// SDT actual : running service without descriptors
+	s = { 0x42, 0, 0 };
+	put16(s, tsid);
+	s.insert(s.end(), { version, 0x00, 0x00 });
+	put16(s, network_id);
+	s.push_back(0xff);
+	put16(s, service_id);
+	s.push_back(0xfc);
+	put16(s, 0x8000);
+	section_packet(sdt_, PID_SDT, s);
+
+	video_.fill(0xff);
+	video_[0] = 0x47;
+	video_[1] = PID_VIDEO >> 8;
+	video_[2] = PID_VIDEO & 0xff;
+	video_[3] = 0x10;
+	null_.fill(0xff);
+	null_[0] = 0x47;
+	null_[1] = PID_NULL >> 8;
+	null_[2] = PID_NULL & 0xff;
+	null_[3] = 0x10;
+
+	random_ = options_.seed ^ 0x9e3779b97f4a7c15ULL;
+	if (random_ == 0) { random_ = 1; }
+	pat_every_ = every(options_.pat_interval_ms);
+	nit_every_ = every(options_.nit_interval_ms);
+	sdt_every_ = every(options_.sdt_interval_ms);
+	next_nit_ = 2;
+	next_sdt_ = 3;
+	null_threshold_ = threshold(options_.null_ratio);
+	tei_threshold_ = threshold(options_.tei_rate);
+	cc_error_threshold_ = threshold(options_.cc_error_rate);
+	sync_loss_threshold_ = threshold(options_.sync_loss_rate);
+
+	// 27MHz ticks per packet, kept as an exact fraction of the bitrate
+	uint64_t bitrate = static_cast<uint64_t>(options_.bitrate_kbps) * 1000;
+	arrival_time_step_ = 188 * 8 * ARRIVAL_CLOCK_HZ / bitrate;
+	arrival_time_remainder_ = 188 * 8 * ARRIVAL_CLOCK_HZ % bitrate;
+}
+
+size_t TSGenerator::generate(uint8_t* buf, size_t size)
+{
+	size_t n = 0;
+	while (size - n >= options_.packet_size)
+	{
+		n += write_packet(buf + n, next_packet());
+	}
+	return n;
+}
+
+uint32_t TSGenerator::crc32(const uint8_t* p, size_t size)
+{
+	static const auto table = [] {
+		std::array<uint32_t, 256> t = {};
+		for (uint32_t i = 0; i < t.size(); i++)
+		{
+			auto c = i << 24;
+			for (auto j = 0; j < 8; j++)
+			{
+				c = (c & 0x80000000) ? (c << 1) ^ 0x04c11db7 : c << 1;
+			}
+			t[i] = c;
+		}
+		return t;
+	}();
+
+	uint32_t crc = 0xffffffff;
+	for (size_t i = 0; i < size; i++)
+	{
+		crc = (crc << 8) ^ table[((crc >> 24) ^ p[i]) & 0xff];
+	}
+	return crc;
+}
+
+uint64_t TSGenerator::next_random()
+{
+	// xorshift64*
+	random_ ^= random_ >> 12;
+	random_ ^= random_ << 25;
+	random_ ^= random_ >> 27;
+	return random_ * 0x2545f4914f6cdd1dULL;
+}
+
+uint64_t TSGenerator::every(uint32_t interval_ms) const
+{
+	auto packets = static_cast<uint64_t>(options_.bitrate_kbps) * interval_ms / (188 * 8);
+	return std::max<uint64_t>(packets, 4);
+}
+
+uint64_t TSGenerator::threshold(double rate)
+{
+	if (rate <= 0) { return 0; }
+	if (rate >= 1) { return UINT64_MAX; }
+	return static_cast<uint64_t>(rate * 18446744073709551616.0);
+}
+
+void TSGenerator::section_packet(Packet& packet, uint16_t pid, std::vector<uint8_t> section)
+{
+	auto length = section.size() - 3 + 4;
+	section[1] = 0xb0 | ((length >> 8) & 0x0f);
+	section[2] = length & 0xff;
+	auto crc = crc32(section.data(), section.size());
+	for (auto shift = 24; shift >= 0; shift -= 8)
+	{
+		section.push_back((crc >> shift) & 0xff);
+	}
+
+	packet.fill(0xff);
+	packet[0] = 0x47;
+	packet[1] = 0x40 | (pid >> 8);
+	packet[2] = pid & 0xff;
+	packet[3] = 0x10;
+	packet[4] = 0x00;
+	std::memcpy(&packet[5], section.data(), section.size());
+}
+
+const TSGenerator::Packet& TSGenerator::next_packet()
+{
+	if (pending_pmt_)
+	{
+		pending_pmt_ = false;
+		return pmt_;
+	}
+	if (packets_ >= next_pat_)
+	{
+		next_pat_ += pat_every_;
+		pending_pmt_ = true;
+		return pat_;
+	}
+	if (packets_ >= next_nit_)
+	{
+		next_nit_ += nit_every_;
+		return nit_;
+	}
+	if (packets_ >= next_sdt_)
+	{
+		next_sdt_ += sdt_every_;
+		return sdt_;
+	}
+	if (null_threshold_ != 0 && next_random() < null_threshold_)
+	{
+		return null_;
+	}
+	return video_;
+}
+
+size_t TSGenerator::write_packet(uint8_t* p, const Packet& packet)
+{
+	packets_++;
+
+	auto ts = p;
+	if (options_.packet_size == 192)
+	{
+		// TP_extra_header : copy_permission_indicator and arrival_time_stamp
+		auto ats = static_cast<uint32_t>(arrival_time_ & ARRIVAL_TIME_MASK);
+		p[0] = ats >> 24;
+		p[1] = ats >> 16;
+		p[2] = ats >> 8;
+		p[3] = ats;
+		ts += 4;
+		uint64_t bitrate = static_cast<uint64_t>(options_.bitrate_kbps) * 1000;
+		arrival_time_ += arrival_time_step_;
+		arrival_time_fraction_ += arrival_time_remainder_;
+		if (arrival_time_fraction_ >= bitrate)
+		{
+			arrival_time_fraction_ -= bitrate;
+			arrival_time_++;
+		}
+	}
+	std::memcpy(ts, packet.data(), packet.size());
+	if (options_.packet_size == 204)
+	{
+		// no real Reed-Solomon parity, receivers only skip it
+		std::memset(ts + 188, 0, 16);
+	}
+
+	uint16_t pid = ((ts[1] & 0x1f) << 8) | ts[2];
+	if (pid != PID_NULL)
+	{
+		auto& cc = continuity_counters_[pid];
+		if (cc_error_threshold_ != 0 && next_random() < cc_error_threshold_)
+		{
+			cc++;
+		}
+		ts[3] = (ts[3] & 0xf0) | (cc & 0x0f);
+		cc = (cc + 1) & 0x0f;
+	}
+	if (tei_threshold_ != 0 && next_random() < tei_threshold_)
+	{
+		ts[1] |= 0x80;
+	}
+	if (sync_loss_threshold_ != 0 && next_random() < sync_loss_threshold_)
+	{
+		// truncated packet, the next one starts off the 188 byte grid
+		return 1 + next_random() % (options_.packet_size - 1);
+	}
+	return options_.packet_size;
+}
+
+}
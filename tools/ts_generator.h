@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <vector>
+
+namespace px4tsid
+{
+
+// Synthetic ISDB-S transport stream of a single slot: PAT/PMT, NIT and SDT
+// at their repetition intervals, one dummy video PID and null padding, with
+// optional TEI, continuity counter and sync errors. The output only depends
+// on the options, so the same seed always produces the same bytes.
+class TSGenerator
+{
+public:
+	struct Options
+	{
+		uint16_t transport_stream_id = 0x4010;
+		uint8_t version = 0;
+		uint32_t bitrate_kbps = 30000;
+		uint32_t pat_interval_ms = 100;
+		uint32_t nit_interval_ms = 1000;
+		uint32_t sdt_interval_ms = 1000;
+		double null_ratio = 0.1;
+		double tei_rate = 0;
+		double cc_error_rate = 0;
+		double sync_loss_rate = 0;
+		uint32_t packet_size = 188;
+		uint64_t seed = 1;
+	};
+
+	explicit TSGenerator(const Options& options);
+	~TSGenerator() = default;
+
+	// fills buf with whole packets and returns the number of bytes written
+	size_t generate(uint8_t* buf, size_t size);
+	uint64_t packets() const { return packets_; }
+
+	static uint32_t crc32(const uint8_t* p, size_t size);
+
+private:
+	using Packet = std::array<uint8_t, 188>;
+
+	static constexpr uint16_t PID_PAT = 0x0000;
+	static constexpr uint16_t PID_NIT = 0x0010;
+	static constexpr uint16_t PID_SDT = 0x0011;
+	static constexpr uint16_t PID_PMT = 0x01f0;
+	static constexpr uint16_t PID_VIDEO = 0x0100;
+	static constexpr uint16_t PID_NULL = 0x1fff;
+
+	Options options_;
+	Packet pat_;
+	Packet pmt_;
+	Packet nit_;
+	Packet sdt_;
+	Packet video_;
+	Packet null_;
+	std::array<uint8_t, 0x2000> continuity_counters_ = {};
+	uint64_t packets_ = 0;
+	uint64_t random_;
+	uint64_t pat_every_;
+	uint64_t nit_every_;
+	uint64_t sdt_every_;
+	uint64_t next_pat_ = 0;
+	uint64_t next_nit_ = 0;
+	uint64_t next_sdt_ = 0;
+	bool pending_pmt_ = false;
+	uint64_t null_threshold_;
+	uint64_t tei_threshold_;
+	uint64_t cc_error_threshold_;
+	uint64_t sync_loss_threshold_;
+	uint64_t arrival_time_ = 0;
+	uint64_t arrival_time_step_;
+	uint64_t arrival_time_fraction_ = 0;
+	uint64_t arrival_time_remainder_;
+
+	uint64_t next_random();
+	uint64_t every(uint32_t interval_ms) const;
+	static uint64_t threshold(double rate);
+	static void section_packet(Packet& packet, uint16_t pid, std::vector<uint8_t> section);
+	const Packet& next_packet();
+	size_t write_packet(uint8_t* p, const Packet& packet);
+};
+
+}